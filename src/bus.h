@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef BUS_H_
+#define BUS_H_
+
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/* Bare-metal bus instances. Every instance has its own registers, pins, interrupt, semaphore
+ * and buffers so several buses can run at the same time. The single bus tests use instance 1.
+ * Modes built on fixed timers and DPPI channels (delayed and hardware CS, bursts, streaming,
+ * batched reads, clock stretch measurement, UART ring and low power) only run on instance 1.
+ */
+
+struct spim_instance {
+	NRF_SPIM_Type *regs;
+	IRQn_Type irq;
+	uint8_t pin_sck;
+	uint8_t pin_mosi;
+	uint8_t pin_miso;
+	uint8_t pin_cs;
+	uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	struct k_sem done;
+	/* Restart from the interrupt and count the bytes until cleared. */
+	volatile bool repeat;
+	uint64_t bytes;
+};
+
+struct uarte_instance {
+	NRF_UARTE_Type *regs;
+	IRQn_Type irq;
+	uint8_t pin_txd;
+	uint8_t pin_rxd;
+	uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	struct k_sem done;
+	/* Restart from the interrupt and count the bytes until cleared. */
+	volatile bool repeat;
+	uint64_t bytes;
+};
+
+struct twim_instance {
+	NRF_TWIM_Type *regs;
+	IRQn_Type irq;
+	uint8_t pin_scl;
+	uint8_t pin_sda;
+	uint8_t address;
+	uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	struct k_sem done;
+	/* ERROR seen since the transfer started. */
+	volatile bool error;
+};
+
+struct spis_instance {
+	NRF_SPIS_Type *regs;
+	IRQn_Type irq;
+	uint8_t pin_sck;
+	uint8_t pin_mosi;
+	uint8_t pin_miso;
+	uint8_t pin_cs;
+	uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	struct k_sem done;
+};
+
+struct twis_instance {
+	NRF_TWIS_Type *regs;
+	IRQn_Type irq;
+	uint8_t pin_scl;
+	uint8_t pin_sda;
+	uint8_t address;
+	uint8_t *tx_buffer;
+	uint8_t *rx_buffer;
+	struct k_sem done;
+	/* Buffers are prepared in advance and re-prepared on STOPPED, READ/WRITE don't suspend. */
+	bool prearmed;
+	/* Directions started since the transfer was armed. */
+	volatile uint32_t started;
+};
+
+#define TWIS_STARTED_RX (1 << 0)
+#define TWIS_STARTED_TX (1 << 1)
+
+/* BAUDRATE register value for any rate, the UARTE divides 16 MHz with a 20 bit fraction. */
+#define UART_BAUDRATE(bps) \
+	((uint32_t)((((uint64_t)(bps) << 32) / 16000000 + 0x800) & 0xFFFFF000))
+
+extern struct spim_instance spim1;
+extern struct uarte_instance uarte1;
+extern struct twim_instance twim1;
+extern struct spis_instance spis1;
+extern struct twis_instance twis1;
+
+void spim_instance_init(struct spim_instance *spim, uint32_t bitrate);
+int spim_instance_transfer(struct spim_instance *spim, int tx_size, int rx_size);
+void spim_instance_deinit(struct spim_instance *spim);
+
+void uart_instance_init(struct uarte_instance *uarte, uint32_t bitrate);
+int uart_instance_send(struct uarte_instance *uarte, int size);
+int uart_instance_recv(struct uarte_instance *uarte, int size, k_timeout_t timeout);
+void uart_instance_deinit(struct uarte_instance *uarte);
+
+void twim_instance_init(struct twim_instance *twim, uint32_t bitrate);
+int twim_instance_transfer(struct twim_instance *twim, int tx_size, int rx_size);
+void twim_instance_deinit(struct twim_instance *twim);
+
+void spis_instance_init(struct spis_instance *spis, uint32_t bitrate);
+int spis_instance_transfer(struct spis_instance *spis, int tx_size, int rx_size,
+			   k_timeout_t timeout);
+void spis_instance_deinit(struct spis_instance *spis);
+
+void twis_instance_init(struct twis_instance *twis, uint32_t bitrate);
+int twis_instance_transfer(struct twis_instance *twis, int tx_size, int rx_size,
+			   k_timeout_t timeout);
+void twis_instance_deinit(struct twis_instance *twis);
+
+/* Keep a bus busy with back-to-back transfers of 'size' bytes without the thread, stop
+ * returns the number of bytes moved.
+ */
+void spim_repeat_start(struct spim_instance *spim, int size, bool tx);
+uint64_t spim_repeat_stop(struct spim_instance *spim);
+void uart_repeat_start(struct uarte_instance *uarte, int size);
+uint64_t uart_repeat_stop(struct uarte_instance *uarte);
+
+#endif /* BUS_H_ */
@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "frame.h"
+
+/* Reflected polynomial of the IEEE 802.3 CRC32. */
+#define CRC32_POLY 0xEDB88320
+
+/* Slicing-by-4: table k holds the CRC of a byte followed by k zero bytes, so four input bytes
+ * are folded in with four lookups instead of four dependent steps.
+ */
+static uint32_t crc_table[4][256];
+static bool crc_table_ready;
+
+static void crc_table_init(void)
+{
+	for (int i = 0; i < 256; i++) {
+		uint32_t crc = i;
+
+		for (int bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (crc & 1 ? CRC32_POLY : 0);
+		}
+		crc_table[0][i] = crc;
+	}
+
+	for (int i = 0; i < 256; i++) {
+		for (int k = 1; k < 4; k++) {
+			uint32_t crc = crc_table[k - 1][i];
+
+			crc_table[k][i] = (crc >> 8) ^ crc_table[0][crc & 0xff];
+		}
+	}
+
+	crc_table_ready = true;
+}
+
+uint32_t frame_crc32(const uint8_t *data, int size)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	if (!crc_table_ready) {
+		crc_table_init();
+	}
+
+	for (; size >= 4; data += 4, size -= 4) {
+		crc ^= data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32_t)data[3] << 24);
+		crc = crc_table[3][crc & 0xff] ^ crc_table[2][(crc >> 8) & 0xff] ^
+		      crc_table[1][(crc >> 16) & 0xff] ^ crc_table[0][crc >> 24];
+	}
+
+	for (; size; data++, size--) {
+		crc = (crc >> 8) ^ crc_table[0][(crc ^ *data) & 0xff];
+	}
+
+	return ~crc;
+}
+
+int frame_build(uint8_t *buffer, uint16_t seq, int payload_size)
+{
+	uint8_t *payload = &buffer[FRAME_HEADER_SIZE];
+	uint32_t crc;
+
+	buffer[0] = payload_size >> 8;
+	buffer[1] = payload_size & 0xff;
+	buffer[2] = seq >> 8;
+	buffer[3] = seq & 0xff;
+
+	for (int i = 0; i < payload_size; i++) {
+		payload[i] = seq + i;
+	}
+
+	crc = frame_crc32(buffer, FRAME_HEADER_SIZE + payload_size);
+	payload[payload_size + 0] = crc;
+	payload[payload_size + 1] = crc >> 8;
+	payload[payload_size + 2] = crc >> 16;
+	payload[payload_size + 3] = crc >> 24;
+
+	return payload_size + FRAME_OVERHEAD;
+}
+
+static void frame_account(struct frame_rx_stats *stats, uint16_t seq, int payload_size)
+{
+	int16_t ahead = seq - stats->next_seq;
+
+	stats->frames++;
+
+	if (stats->synced && ahead < 0) {
+		stats->duplicated++;
+		return;
+	}
+
+	/* The first frame only sets the expected sequence number. */
+	if (stats->synced) {
+		stats->lost += ahead;
+	}
+	stats->synced = true;
+	stats->next_seq = seq + 1;
+	stats->payload_bytes += payload_size;
+}
+
+void frame_parse(const uint8_t *buffer, int size, struct frame_rx_stats *stats)
+{
+	while (size >= FRAME_OVERHEAD) {
+		int payload_size = (buffer[0] << 8) + buffer[1];
+		int frame_size = payload_size + FRAME_OVERHEAD;
+		const uint8_t *crc = &buffer[FRAME_HEADER_SIZE + payload_size];
+
+		/* Without a valid length the next frame can't be found. */
+		if (frame_size > size) {
+			stats->corrupted++;
+			return;
+		}
+
+		if (frame_crc32(buffer, FRAME_HEADER_SIZE + payload_size) !=
+		    (crc[0] | (crc[1] << 8) | (crc[2] << 16) | ((uint32_t)crc[3] << 24))) {
+			stats->corrupted++;
+			return;
+		}
+
+		frame_account(stats, (buffer[2] << 8) + buffer[3], payload_size);
+
+		buffer += frame_size;
+		size -= frame_size;
+	}
+}
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Frames for streaming links: [payload length][sequence number][payload][CRC32]. Length and
+ * sequence number are 16 bit big endian like the length header of the other tests, the CRC32
+ * (IEEE 802.3) covers header and payload and is sent little endian.
+ */
+
+#define FRAME_HEADER_SIZE 4
+#define FRAME_CRC_SIZE 4
+#define FRAME_OVERHEAD (FRAME_HEADER_SIZE + FRAME_CRC_SIZE)
+
+/* What the receiver has seen so far. */
+struct frame_rx_stats {
+	uint32_t frames;	/* Frames with a good CRC, duplicates included. */
+	uint32_t lost;		/* Sequence numbers skipped. */
+	uint32_t duplicated;	/* Sequence numbers seen before. */
+	uint32_t corrupted;	/* Bad CRC or length, the rest of the transfer is dropped. */
+	uint64_t payload_bytes;	/* Payload of new, good frames. */
+	uint16_t next_seq;
+	bool synced;
+};
+
+uint32_t frame_crc32(const uint8_t *data, int size);
+
+/* Write a frame with sequence number 'seq' and 'payload_size' bytes of counting pattern
+ * starting at 'seq', returns the frame size.
+ */
+int frame_build(uint8_t *buffer, uint16_t seq, int payload_size);
+
+/* Check the frames packed into 'size' received bytes and add them to 'stats'. */
+void frame_parse(const uint8_t *buffer, int size, struct frame_rx_stats *stats);
+
+#endif /* FRAME_H_ */
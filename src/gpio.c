@@ -9,16 +9,51 @@
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
+#include "lp_log.h"
+#include "stats.h"
+
 #define GPIO        NRF_P0_NS
 #define GPIOTE      NRF_GPIOTE1_NS
+#define TIMER       NRF_TIMER2_NS
 
 #define PIN_INPUT   8		/* BUTTON1 */
 #define PIN_OUTPUT  0		/* LED1 */
+#define PIN_STIMULUS 17		/* Connect to PIN_INPUT for the histogram. */
+
+/* The histogram drives the stimulus pin from TIMER2 and captures the input edge. */
+#define STIMULUS_GPIOTE_NR  3
+#define INPUT_GPIOTE_NR     4
+#define STIMULUS_DPPI_CHANNEL 12
+#define INPUT_DPPI_CHANNEL    13
+#define TIMER_MHZ   16
+/* Stimulus 100 µs after the timer starts, the CPU is asleep by then. */
+#define STIMULUS_DELAY (100 * TIMER_MHZ)
+#define HIST_SAMPLES 2000
+#define HIST_BINS    16
+#define HIST_WIDTH   40
+#define HIST_BAR     "########################################"
+
+#define CC_STIMULUS 0
+#define CC_EDGE     1
+#define CC_OUTPUT   2
+#define CC_THREAD   3
+
+/* Without the stimulus wire no edge comes. */
+#define HIST_TIMEOUT K_MSEC(10)
 
 int lp_printf(const char *fmt, ...);
 
+extern bool constant_latency;
+
 static bool test_done;
 
+K_SEM_DEFINE(hist_sem, 0, 1);
+K_TIMER_DEFINE(hist_timeout, NULL, NULL);
+
+static volatile bool hist_done;
+static uint32_t isr_samples[HIST_SAMPLES];
+static uint32_t thread_samples[HIST_SAMPLES];
+
  void gpio_init(uint32_t bitrate)
 {
 	/* Enable output pin to low. */
@@ -96,3 +131,185 @@ void gpio_deinit(void)
 	/* Disable input pin. */
 	GPIO->PIN_CNF[PIN_INPUT] = 0;
 }
+
+void gpio_hist_init(uint32_t bitrate)
+{
+	gpio_init(bitrate);
+
+	/* TIMER2 at 16 MHz pulls the stimulus pin low on compare 0 using GPIOTE. */
+	TIMER->MODE = TIMER_MODE_MODE_Timer;
+	TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	TIMER->PRESCALER = 0;
+	TIMER->CC[CC_STIMULUS] = STIMULUS_DELAY;
+	GPIOTE->CONFIG[STIMULUS_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Task << GPIOTE_CONFIG_MODE_Pos |
+					     PIN_STIMULUS << GPIOTE_CONFIG_PSEL_Pos |
+					     GPIOTE_CONFIG_OUTINIT_High << GPIOTE_CONFIG_OUTINIT_Pos;
+	TIMER->PUBLISH_COMPARE[CC_STIMULUS] = TIMER_PUBLISH_COMPARE_EN_Msk |
+					      STIMULUS_DPPI_CHANNEL;
+	GPIOTE->SUBSCRIBE_CLR[STIMULUS_GPIOTE_NR] = GPIOTE_SUBSCRIBE_CLR_EN_Msk |
+						    STIMULUS_DPPI_CHANNEL;
+
+	/* Capture the time the input edge is seen. */
+	GPIOTE->CONFIG[INPUT_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Event << GPIOTE_CONFIG_MODE_Pos |
+					  PIN_INPUT << GPIOTE_CONFIG_PSEL_Pos |
+					  GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos;
+	GPIOTE->PUBLISH_IN[INPUT_GPIOTE_NR] = GPIOTE_PUBLISH_IN_EN_Msk | INPUT_DPPI_CHANNEL;
+	TIMER->SUBSCRIBE_CAPTURE[CC_EDGE] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | INPUT_DPPI_CHANNEL;
+
+	NRF_DPPIC->CHENSET = (1 << STIMULUS_DPPI_CHANNEL) | (1 << INPUT_DPPI_CHANNEL);
+
+	lp_printf("    Stimulus P0.%02d, connect to input\n", PIN_STIMULUS);
+}
+
+static void gpio_hist_isr(const void *arg)
+{
+	/* Output pin low, time stamped right after the write. */
+	GPIO->OUTCLR = 1 << PIN_OUTPUT;
+	TIMER->TASKS_CAPTURE[CC_OUTPUT] = 1;
+
+	GPIOTE->EVENTS_IN[INPUT_GPIOTE_NR] = 0;
+	hist_done = true;
+	k_sem_give(&hist_sem);
+}
+
+BUILD_ASSERT(sizeof(HIST_BAR) - 1 == HIST_WIDTH);
+
+static void print_histogram(const char *label, uint32_t *samples)
+{
+	struct stats stats;
+	uint32_t bins[HIST_BINS] = {0};
+	uint32_t width;
+	uint32_t peak = 0;
+
+	stats_calc(samples, HIST_SAMPLES, &stats);
+	lp_printf("  %-13s min %6u p50 %6u p99 %6u max %6u ns\n", label,
+		  stats.min * 1000 / TIMER_MHZ, stats.p50 * 1000 / TIMER_MHZ,
+		  stats.p99 * 1000 / TIMER_MHZ, stats.max * 1000 / TIMER_MHZ);
+
+	/* Bins from min to p99, the slower samples end up in the last bin. */
+	width = (stats.p99 - stats.min) / HIST_BINS + 1;
+	for (int i = 0; i < HIST_SAMPLES; i++) {
+		bins[MIN((samples[i] - stats.min) / width, HIST_BINS - 1)]++;
+	}
+	for (int i = 0; i < HIST_BINS; i++) {
+		peak = MAX(peak, bins[i]);
+	}
+	for (int i = 0; i < HIST_BINS; i++) {
+		int bar = (bins[i] * HIST_WIDTH + peak - 1) / peak;
+
+		/* One record per bin while the console output is deferred. */
+		lp_printf("    %s%6u ns %5u %.*s\n", i == HIST_BINS - 1 ? ">=" : "  ",
+			  (stats.min + i * width) * 1000 / TIMER_MHZ, bins[i], bar, HIST_BAR);
+	}
+}
+
+static bool gpio_hist_run(const char *label, bool wfi)
+{
+	bool deferred;
+
+	for (int i = 0; i < HIST_SAMPLES; i++) {
+		/* Stimulus high and output high. */
+		GPIOTE->TASKS_SET[STIMULUS_GPIOTE_NR] = 1;
+		GPIO->OUTSET = 1 << PIN_OUTPUT;
+		k_busy_wait(10);
+		GPIOTE->EVENTS_IN[INPUT_GPIOTE_NR] = 0;
+		hist_done = false;
+		k_sem_reset(&hist_sem);
+
+		TIMER->TASKS_CLEAR = 1;
+		TIMER->TASKS_START = 1;
+
+		if (wfi) {
+			/* The system timer wakes the CPU when the timeout expires. */
+			k_timer_start(&hist_timeout, HIST_TIMEOUT, K_NO_WAIT);
+			while (!hist_done && !k_timer_status_get(&hist_timeout)) {
+				__WFI();
+			}
+			k_timer_stop(&hist_timeout);
+		} else {
+			k_sem_take(&hist_sem, HIST_TIMEOUT);
+		}
+
+		if (!hist_done) {
+			TIMER->TASKS_STOP = 1;
+			lp_printf("No edge on P0.%02d, is P0.%02d connected?\n", PIN_INPUT,
+				  PIN_STIMULUS);
+			return false;
+		}
+
+		TIMER->TASKS_CAPTURE[CC_THREAD] = 1;
+		TIMER->TASKS_STOP = 1;
+
+		isr_samples[i] = TIMER->CC[CC_OUTPUT] - TIMER->CC[CC_EDGE];
+		thread_samples[i] = TIMER->CC[CC_THREAD] - TIMER->CC[CC_EDGE];
+	}
+
+	/* The measurement of this run is done, print its report now instead of keeping it for
+	 * the end of the test and defer again for the next run.
+	 */
+	deferred = lp_log_active();
+	if (deferred) {
+		lp_log_flush();
+	}
+	lp_printf("%s\n", label);
+	print_histogram("Edge to ISR", isr_samples);
+	print_histogram("Edge to thread", thread_samples);
+	if (deferred) {
+		lp_log_begin();
+	}
+
+	return true;
+}
+
+/* Edge to output latency histograms in both power modes, with the thread sleeping in __WFI()
+ * and in a semaphore wait. The power mode selected in the menu is restored afterwards.
+ */
+int gpio_histogram(int size)
+{
+	int err = -ETIMEDOUT;
+
+	GPIOTE->INTENSET = 1 << INPUT_GPIOTE_NR;
+	irq_connect_dynamic(GPIOTE1_IRQn, 0, gpio_hist_isr, NULL, 0);
+	irq_enable(GPIOTE1_IRQn);
+
+	NRF_POWER_NS->TASKS_CONSTLAT = 1;
+	if (gpio_hist_run("Constant latency, __WFI()", true) &&
+	    gpio_hist_run("Constant latency, semaphore", false)) {
+		NRF_POWER_NS->TASKS_LOWPWR = 1;
+		if (gpio_hist_run("Low power, __WFI()", true) &&
+		    gpio_hist_run("Low power, semaphore", false)) {
+			err = 0;
+		}
+	}
+
+	if (constant_latency) {
+		NRF_POWER_NS->TASKS_CONSTLAT = 1;
+	} else {
+		NRF_POWER_NS->TASKS_LOWPWR = 1;
+	}
+
+	irq_disable(GPIOTE1_IRQn);
+	GPIOTE->INTENCLR = 1 << INPUT_GPIOTE_NR;
+
+	return err;
+}
+
+void gpio_hist_deinit(void)
+{
+	TIMER->TASKS_STOP = 1;
+	TIMER->PUBLISH_COMPARE[CC_STIMULUS] = 0;
+	TIMER->SUBSCRIBE_CAPTURE[CC_EDGE] = 0;
+	GPIOTE->SUBSCRIBE_CLR[STIMULUS_GPIOTE_NR] = 0;
+	GPIOTE->PUBLISH_IN[INPUT_GPIOTE_NR] = 0;
+	NRF_DPPIC->CHENCLR = (1 << STIMULUS_DPPI_CHANNEL) | (1 << INPUT_DPPI_CHANNEL);
+
+	/* Disable in two steps to prevent a current leak. */
+	GPIOTE->CONFIG[STIMULUS_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Disabled |
+					     (PIN_STIMULUS << GPIOTE_CONFIG_PSEL_Pos);
+	GPIOTE->CONFIG[STIMULUS_GPIOTE_NR] = 0;
+	GPIOTE->CONFIG[INPUT_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Disabled |
+					  (PIN_INPUT << GPIOTE_CONFIG_PSEL_Pos);
+	GPIOTE->CONFIG[INPUT_GPIOTE_NR] = 0;
+
+	gpio_deinit();
+}
@@ -0,0 +1,153 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+/* Interrupt latency of the ways a driver can connect its interrupt. A TIMER2 compare triggers
+ * an EGU through DPPI while the thread sleeps on a semaphore. The ISR captures TIMER2 on entry
+ * and gives the semaphore, the thread captures TIMER2 again when it runs. Every EGU has its own
+ * vector connected in a different way: dynamic, static through the software ISR table, direct,
+ * and zero latency when CONFIG_ZERO_LATENCY_IRQS is enabled.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+
+#include "stats.h"
+
+#define TIMER NRF_TIMER2_NS
+#define IRQ_BENCH_DPPI_CHANNEL 11
+#define IRQ_BENCH_PRIO 0
+#define IRQ_BENCH_SAMPLES 1000
+/* Interrupt 100 µs after the timer started, the thread is asleep by then. */
+#define IRQ_BENCH_DELAY 1600
+#define TIMER_MHZ 16
+
+int lp_printf(const char *fmt, ...);
+
+K_SEM_DEFINE(irq_bench_done, 0, 1);
+
+static volatile bool irq_bench_flag;
+static uint32_t isr_samples[IRQ_BENCH_SAMPLES];
+static uint32_t wake_samples[IRQ_BENCH_SAMPLES];
+
+static inline void irq_bench_event(NRF_EGU_Type *egu)
+{
+	TIMER->TASKS_CAPTURE[1] = 1;
+	egu->EVENTS_TRIGGERED[0] = 0;
+}
+
+static void dynamic_isr(const void *arg)
+{
+	irq_bench_event(NRF_EGU1_NS);
+	k_sem_give(&irq_bench_done);
+}
+
+static void static_isr(const void *arg)
+{
+	irq_bench_event(NRF_EGU2_NS);
+	k_sem_give(&irq_bench_done);
+}
+
+ISR_DIRECT_DECLARE(direct_isr)
+{
+	irq_bench_event(NRF_EGU3_NS);
+	k_sem_give(&irq_bench_done);
+	ISR_DIRECT_PM();
+	return 1;
+}
+
+#if defined(CONFIG_ZERO_LATENCY_IRQS)
+/* Kernel calls are not allowed at zero latency, the thread polls a flag instead. */
+ISR_DIRECT_DECLARE(zli_isr)
+{
+	irq_bench_event(NRF_EGU4_NS);
+	irq_bench_flag = true;
+	return 0;
+}
+#endif
+
+static void print_stats(const char *label, uint32_t *samples)
+{
+	struct stats stats;
+
+	stats_calc(samples, IRQ_BENCH_SAMPLES, &stats);
+	lp_printf("  %-12s min %5u p50 %5u p99 %5u max %5u ns\n", label,
+		  stats.min * 1000 / TIMER_MHZ, stats.p50 * 1000 / TIMER_MHZ,
+		  stats.p99 * 1000 / TIMER_MHZ, stats.max * 1000 / TIMER_MHZ);
+}
+
+static void irq_bench_run(const char *label, NRF_EGU_Type *egu, IRQn_Type irq, bool poll)
+{
+	egu->EVENTS_TRIGGERED[0] = 0;
+	egu->INTENSET = EGU_INTENSET_TRIGGERED0_Msk;
+	egu->SUBSCRIBE_TRIGGER[0] = EGU_SUBSCRIBE_TRIGGER_EN_Msk | IRQ_BENCH_DPPI_CHANNEL;
+	irq_enable(irq);
+
+	for (int i = 0; i < IRQ_BENCH_SAMPLES; i++) {
+		irq_bench_flag = false;
+		k_sem_reset(&irq_bench_done);
+		TIMER->TASKS_CLEAR = 1;
+		TIMER->TASKS_START = 1;
+
+		if (poll) {
+			while (!irq_bench_flag) {
+			}
+		} else {
+			k_sem_take(&irq_bench_done, K_MSEC(10));
+		}
+
+		TIMER->TASKS_CAPTURE[2] = 1;
+		TIMER->TASKS_STOP = 1;
+		isr_samples[i] = TIMER->CC[1] - TIMER->CC[0];
+		wake_samples[i] = TIMER->CC[2] - TIMER->CC[0];
+	}
+
+	irq_disable(irq);
+	egu->SUBSCRIBE_TRIGGER[0] = 0;
+	egu->INTENCLR = EGU_INTENCLR_TRIGGERED0_Msk;
+
+	lp_printf("%s\n", label);
+	print_stats("ISR entry", isr_samples);
+	print_stats("Thread wake", wake_samples);
+}
+
+void irq_bench_init(uint32_t bitrate)
+{
+	/* 16 MHz, compare 0 triggers the EGUs through DPPI. */
+	TIMER->MODE = TIMER_MODE_MODE_Timer;
+	TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	TIMER->PRESCALER = 0;
+	TIMER->CC[0] = IRQ_BENCH_DELAY;
+	TIMER->PUBLISH_COMPARE[0] = TIMER_PUBLISH_COMPARE_EN_Msk | IRQ_BENCH_DPPI_CHANNEL;
+	NRF_DPPIC->CHENSET = (1 << IRQ_BENCH_DPPI_CHANNEL);
+
+	irq_connect_dynamic(EGU1_IRQn, IRQ_BENCH_PRIO, dynamic_isr, NULL, 0);
+	IRQ_CONNECT(EGU2_IRQn, IRQ_BENCH_PRIO, static_isr, NULL, 0);
+	IRQ_DIRECT_CONNECT(EGU3_IRQn, IRQ_BENCH_PRIO, direct_isr, 0);
+#if defined(CONFIG_ZERO_LATENCY_IRQS)
+	IRQ_DIRECT_CONNECT(EGU4_IRQn, 0, zli_isr, IRQ_ZERO_LATENCY);
+#endif
+}
+
+int irq_bench(int size)
+{
+	irq_bench_run("Dynamic ISR", NRF_EGU1_NS, EGU1_IRQn, false);
+	irq_bench_run("Static ISR", NRF_EGU2_NS, EGU2_IRQn, false);
+	irq_bench_run("Direct ISR", NRF_EGU3_NS, EGU3_IRQn, false);
+#if defined(CONFIG_ZERO_LATENCY_IRQS)
+	irq_bench_run("Zero latency ISR, polled", NRF_EGU4_NS, EGU4_IRQn, true);
+#endif
+
+	return 0;
+}
+
+void irq_bench_deinit(void)
+{
+	TIMER->TASKS_STOP = 1;
+	TIMER->PUBLISH_COMPARE[0] = 0;
+	NRF_DPPIC->CHENCLR = (1 << IRQ_BENCH_DPPI_CHANNEL);
+}
@@ -0,0 +1,343 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+/* Loopback on one chip: the instance 1 drivers are the master, instance 2 answers as peer on
+ * the same pins. The peer is interrupt driven and runs concurrently with the master test, no
+ * wiring or second board is needed.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+
+#include "serial_irq.h"
+#include "term_color.h"
+
+#define SPI_SLAVE NRF_SPIS2_NS
+#define UART      NRF_UARTE2_NS
+#define TWI_SLAVE NRF_TWIS2_NS
+#define PEER_IRQn SPIM2_SPIS2_TWIM2_TWIS2_UARTE2_IRQn
+#define GPIO      NRF_P0_NS
+
+/* Same pins as spi_master_bare.c. */
+#define SPI_PIN_SCK  6
+#define SPI_PIN_MISO 3
+#define SPI_PIN_MOSI 2
+#define SPI_PIN_CS   7
+
+/* Same pins as uart_bare.c, crossed. */
+#define UART_PIN_TXD 6
+#define UART_PIN_RXD 7
+
+/* Same pins as twi_master_bare.c. */
+#define TWI_PIN_SCL  2
+#define TWI_PIN_SDA  3
+#define TWI_ADDRESS  42
+
+/* The peer answers receive tests this long after the UART master started receiving. */
+#define UART_PEER_DELAY_MS 1
+
+extern uint8_t tx_buffer[8 * 1024];
+
+int lp_printf(const char *fmt, ...);
+
+void spim_init(uint32_t bitrate);
+int spim_send(int size);
+int spim_recv(int size);
+int spim_transceive(int tx_size, int rx_size);
+void spim_deinit(void);
+void uart_init(uint32_t bitrate);
+int uart_send(int size);
+int uart_recv(int size);
+void uart_deinit(void);
+void twim_init(uint32_t bitrate);
+int twim_send(int size);
+int twim_recv(int size);
+int twim_write_read(int tx_size, int rx_size);
+void twim_deinit(void);
+
+K_SEM_DEFINE(peer_done, 0, 1);
+
+static uint8_t peer_tx[8 * 1024];
+static uint8_t peer_rx[8 * 1024];
+
+static void peer_uart_start(struct k_timer *timer)
+{
+	UART->TASKS_STARTTX = 1;
+}
+
+K_TIMER_DEFINE(peer_uart_timer, peer_uart_start, NULL);
+
+static void peer_isr(const void *arg)
+{
+	if (SPI_SLAVE->EVENTS_END) {
+		SPI_SLAVE->EVENTS_END = 0;
+		k_sem_give(&peer_done);
+	}
+	if (UART->EVENTS_ENDRX) {
+		UART->EVENTS_ENDRX = 0;
+		k_sem_give(&peer_done);
+	}
+	if (UART->EVENTS_ENDTX) {
+		UART->EVENTS_ENDTX = 0;
+		UART->TASKS_STOPTX = 1;
+		k_sem_give(&peer_done);
+	}
+	if (TWI_SLAVE->EVENTS_STOPPED) {
+		TWI_SLAVE->EVENTS_STOPPED = 0;
+		k_sem_give(&peer_done);
+	}
+}
+
+static void peer_irq_init(void)
+{
+	k_sem_reset(&peer_done);
+	serial_irq_connect(PEER_IRQn, peer_isr, NULL);
+	irq_enable(PEER_IRQn);
+}
+
+/* The peer sends the same packet as the master: size header and counting pattern. */
+static void peer_set_tx(int size)
+{
+	memcpy(peer_tx, tx_buffer, size);
+	peer_tx[0] = size >> 8;
+	peer_tx[1] = size & 0xff;
+}
+
+/* Wait for the peer and check what it received, returns 'ret' of the master if all is well. */
+static int peer_check(int ret, int size)
+{
+	if (k_sem_take(&peer_done, K_MSEC(100))) {
+		lp_printf(RED "Peer did not finish\n" NORMAL);
+		return ret < 0 ? ret : -ETIMEDOUT;
+	}
+
+	if (ret < 0 || size == 0) {
+		return ret;
+	}
+
+	if ((peer_rx[0] << 8) + peer_rx[1] != size) {
+		lp_printf(RED "Peer received header %d instead of %d\n" NORMAL,
+			  (peer_rx[0] << 8) + peer_rx[1], size);
+		return -EIO;
+	}
+	for (int i = 2; i < size; i++) {
+		if (peer_rx[i] != (i & 0xff)) {
+			lp_printf(RED "Peer mismatch in byte %d" NORMAL " expected %02x got %02x\n",
+				  i, i & 0xff, peer_rx[i]);
+			return -EIO;
+		}
+	}
+
+	return ret;
+}
+
+/* Output pins of the master need their input buffer connected for the peer to see them. */
+static void connect_input(int pin, uint32_t drive)
+{
+	GPIO->PIN_CNF[pin] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+			     (GPIO_PIN_CNF_INPUT_Connect << GPIO_PIN_CNF_INPUT_Pos) |
+			     (drive << GPIO_PIN_CNF_DRIVE_Pos);
+}
+
+void loop_spi_init(uint32_t bitrate)
+{
+	spim_init(bitrate);
+
+	connect_input(SPI_PIN_SCK, GPIO_PIN_CNF_DRIVE_H0H1);
+	connect_input(SPI_PIN_MOSI, GPIO_PIN_CNF_DRIVE_H0H1);
+	connect_input(SPI_PIN_CS, GPIO_PIN_CNF_DRIVE_H0H1);
+	/* MISO: driven by the peer, read by the master. */
+	connect_input(SPI_PIN_MISO, GPIO_PIN_CNF_DRIVE_H0H1);
+
+	SPI_SLAVE->PSEL.SCK = SPI_PIN_SCK;
+	SPI_SLAVE->PSEL.MISO = SPI_PIN_MISO;
+	SPI_SLAVE->PSEL.MOSI = SPI_PIN_MOSI;
+	SPI_SLAVE->PSEL.CSN = SPI_PIN_CS;
+	SPI_SLAVE->RXD.PTR = (int)peer_rx;
+	SPI_SLAVE->TXD.PTR = (int)peer_tx;
+
+	/* Same mode as the master. */
+	SPI_SLAVE->CONFIG = SPIS_CONFIG_CPOL_Msk | SPIS_CONFIG_CPHA_Msk;
+	SPI_SLAVE->SHORTS = SPIS_SHORTS_END_ACQUIRE_Msk;
+	SPI_SLAVE->INTENSET = SPIS_INTENSET_END_Msk;
+
+	peer_irq_init();
+
+	SPI_SLAVE->ENABLE = SPIS_ENABLE_ENABLE_Enabled;
+
+	lp_printf("    Peer    SPIS2 on the same pins\n");
+}
+
+/* Hand both peer buffers to SPIS2, the master transaction follows immediately. */
+static void loop_spi_arm(int tx_size, int rx_size)
+{
+	peer_set_tx(tx_size);
+	memset(peer_rx, 0, 2);
+	SPI_SLAVE->TXD.MAXCNT = tx_size;
+	SPI_SLAVE->RXD.MAXCNT = rx_size;
+	SPI_SLAVE->TASKS_RELEASE = 1;
+}
+
+int loop_spi_send(int size)
+{
+	loop_spi_arm(0, size);
+
+	return peer_check(spim_send(size), size);
+}
+
+int loop_spi_recv(int size)
+{
+	loop_spi_arm(size, 0);
+
+	return peer_check(spim_recv(size), 0);
+}
+
+int loop_spi_transceive(int tx_size, int rx_size)
+{
+	loop_spi_arm(rx_size, tx_size);
+
+	return peer_check(spim_transceive(tx_size, rx_size), tx_size);
+}
+
+void loop_spi_deinit(void)
+{
+	irq_disable(PEER_IRQn);
+	SPI_SLAVE->INTENCLR = SPIS_INTENCLR_END_Msk;
+	SPI_SLAVE->SHORTS = 0;
+	SPI_SLAVE->ENABLE = 0;
+
+	spim_deinit();
+	GPIO->PIN_CNF[SPI_PIN_MISO] = 0;
+}
+
+void loop_uart_init(uint32_t bitrate)
+{
+	uart_init(bitrate);
+
+	/* UARTE2 listens on the TXD of UARTE1 and drives its RXD. */
+	connect_input(UART_PIN_TXD, GPIO_PIN_CNF_DRIVE_S0S1);
+	connect_input(UART_PIN_RXD, GPIO_PIN_CNF_DRIVE_S0S1);
+
+	UART->PSEL.TXD = UART_PIN_RXD;
+	UART->PSEL.RXD = UART_PIN_TXD;
+	UART->RXD.PTR = (int)peer_rx;
+	UART->TXD.PTR = (int)peer_tx;
+	UART->BAUDRATE = bitrate;
+	UART->CONFIG = 0;
+	UART->INTENSET = UARTE_INTENSET_ENDRX_Msk | UARTE_INTENSET_ENDTX_Msk;
+
+	peer_irq_init();
+
+	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+
+	lp_printf("    Peer    UARTE2 on the same pins, crossed\n");
+}
+
+int loop_uart_send(int size)
+{
+	memset(peer_rx, 0, 2);
+	UART->RXD.MAXCNT = size;
+	UART->TASKS_STARTRX = 1;
+
+	return peer_check(uart_send(size), size);
+}
+
+int loop_uart_recv(int size)
+{
+	/* uart_recv() starts receiving first, the peer follows from the timer. */
+	peer_set_tx(size);
+	UART->TXD.MAXCNT = size;
+	k_timer_start(&peer_uart_timer, K_MSEC(UART_PEER_DELAY_MS), K_NO_WAIT);
+
+	return peer_check(uart_recv(size), 0);
+}
+
+void loop_uart_deinit(void)
+{
+	irq_disable(PEER_IRQn);
+	UART->INTENCLR = UARTE_INTENCLR_ENDRX_Msk | UARTE_INTENCLR_ENDTX_Msk;
+	UART->ENABLE = 0;
+
+	uart_deinit();
+	GPIO->PIN_CNF[UART_PIN_RXD] = 0;
+}
+
+void loop_twi_init(uint32_t bitrate)
+{
+	twim_init(bitrate);
+
+	/* SCL, SDA: open drain with pull-up on both ends, input connected so each end sees the
+	 * other.
+	 */
+	GPIO->PIN_CNF[TWI_PIN_SCL] = (GPIO_PIN_CNF_INPUT_Connect << GPIO_PIN_CNF_INPUT_Pos) |
+				     (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				     (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+	GPIO->PIN_CNF[TWI_PIN_SDA] = (GPIO_PIN_CNF_INPUT_Connect << GPIO_PIN_CNF_INPUT_Pos) |
+				     (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				     (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+
+	TWI_SLAVE->PSEL.SCL = TWI_PIN_SCL;
+	TWI_SLAVE->PSEL.SDA = TWI_PIN_SDA;
+	TWI_SLAVE->RXD.PTR = (int)peer_rx;
+	TWI_SLAVE->RXD.MAXCNT = 0;
+	TWI_SLAVE->TXD.PTR = (int)peer_tx;
+	TWI_SLAVE->TXD.MAXCNT = 0;
+	TWI_SLAVE->ADDRESS[0] = TWI_ADDRESS;
+	TWI_SLAVE->CONFIG = TWIS_CONFIG_ADDRESS0_Msk;
+
+	/* Buffers are prepared before every master transaction, no suspend needed. */
+	TWI_SLAVE->SHORTS = 0;
+	TWI_SLAVE->INTENSET = TWIS_INTENSET_STOPPED_Msk;
+
+	peer_irq_init();
+
+	TWI_SLAVE->ENABLE = TWIS_ENABLE_ENABLE_Enabled;
+
+	lp_printf("    Peer    TWIS2 on the same pins, address %d\n", TWI_ADDRESS);
+}
+
+static void loop_twi_arm(int tx_size, int rx_size)
+{
+	peer_set_tx(tx_size);
+	memset(peer_rx, 0, 2);
+	TWI_SLAVE->TXD.MAXCNT = tx_size;
+	TWI_SLAVE->RXD.MAXCNT = rx_size;
+	TWI_SLAVE->TASKS_PREPARETX = 1;
+	TWI_SLAVE->TASKS_PREPARERX = 1;
+}
+
+int loop_twi_send(int size)
+{
+	loop_twi_arm(0, size);
+
+	return peer_check(twim_send(size), size);
+}
+
+int loop_twi_recv(int size)
+{
+	loop_twi_arm(size, 0);
+
+	return peer_check(twim_recv(size), 0);
+}
+
+int loop_twi_transceive(int tx_size, int rx_size)
+{
+	loop_twi_arm(rx_size, tx_size);
+
+	return peer_check(twim_write_read(tx_size, rx_size), tx_size);
+}
+
+void loop_twi_deinit(void)
+{
+	irq_disable(PEER_IRQn);
+	TWI_SLAVE->INTENCLR = TWIS_INTENCLR_STOPPED_Msk;
+	TWI_SLAVE->ENABLE = 0;
+
+	twim_deinit();
+}
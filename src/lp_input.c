@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+
+#include "lp_input.h"
+
+#define UART   NRF_UARTE0_NS
+#define GPIO   NRF_P0_NS
+#define GPIOTE NRF_GPIOTE1_NS
+
+/* Receive stays on this long after the last byte. */
+#define INPUT_IDLE_MS 5000
+/* A byte ending this soon after the wake-up is what is left of the waking byte. */
+#define INPUT_WAKE_US 2000
+#define INPUT_RING_SIZE 128
+
+enum input_state {
+	INPUT_OFF,
+	INPUT_SENSE,	/* UARTE0 disabled, waiting for RXD low. */
+	INPUT_RX,	/* UARTE0 receiving. */
+	INPUT_STOPPING,	/* Receive stopping, the last bytes still go to the ring. */
+};
+
+K_SEM_DEFINE(input_data, 0, 1);
+
+static const struct device *input_gpio = DEVICE_DT_GET(DT_NODELABEL(gpio0));
+static struct gpio_callback input_gpio_cb;
+static bool input_gpio_driver;
+static volatile enum input_state input_state;
+static uint32_t input_pin;
+static uint32_t input_wake;
+static bool input_waking;
+
+static uint8_t input_byte;
+/* FLUSHRX moves up to four bytes out of the UARTE FIFO. */
+static uint8_t input_flush[4];
+static uint8_t input_ring[INPUT_RING_SIZE];
+static volatile uint32_t input_head;
+static uint32_t input_tail;
+
+static void input_put(uint8_t byte)
+{
+	if (input_head - input_tail < INPUT_RING_SIZE) {
+		input_ring[input_head % INPUT_RING_SIZE] = byte;
+		input_head++;
+	}
+}
+
+static void input_uart_isr(const void *arg)
+{
+	if (!UART->EVENTS_ENDRX) {
+		return;
+	}
+	UART->EVENTS_ENDRX = 0;
+
+	if (input_state != INPUT_RX && input_state != INPUT_STOPPING) {
+		/* Stopped. */
+		return;
+	}
+
+	if (input_waking && k_cyc_to_us_floor32(k_cycle_get_32() - input_wake) < INPUT_WAKE_US) {
+		/* Received from the middle of the byte that woke us up. */
+	} else if (UART->RXD.AMOUNT) {
+		input_put(input_byte);
+	}
+	input_waking = false;
+
+	/* The UARTE FIFO holds the next bytes until receive is restarted. */
+	if (input_state == INPUT_RX) {
+		UART->TASKS_STARTRX = 1;
+	}
+
+	k_sem_give(&input_data);
+}
+
+static void input_rx_start(void)
+{
+	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+
+	UART->RXD.PTR = (int)&input_byte;
+	UART->RXD.MAXCNT = 1;
+	UART->EVENTS_ENDRX = 0;
+	UART->INTENSET = UARTE_INTENSET_ENDRX_Msk;
+	input_state = INPUT_RX;
+	UART->TASKS_STARTRX = 1;
+}
+
+/* A byte arriving while receive stops still ends up in the ring, from the interrupt or from
+ * the FIFO.
+ */
+static void input_rx_stop(void)
+{
+	input_state = INPUT_STOPPING;
+
+	UART->EVENTS_RXTO = 0;
+	UART->TASKS_STOPRX = 1;
+	while (!UART->EVENTS_RXTO) {
+		k_busy_wait(10);
+	}
+	UART->EVENTS_RXTO = 0;
+	UART->INTENCLR = UARTE_INTENCLR_ENDRX_Msk;
+
+	UART->RXD.PTR = (int)input_flush;
+	UART->RXD.MAXCNT = sizeof(input_flush);
+	UART->EVENTS_ENDRX = 0;
+	UART->TASKS_FLUSHRX = 1;
+	while (!UART->EVENTS_ENDRX) {
+		k_busy_wait(10);
+	}
+	UART->EVENTS_ENDRX = 0;
+	for (int i = 0; i < UART->RXD.AMOUNT; i++) {
+		input_put(input_flush[i]);
+	}
+
+	input_state = INPUT_OFF;
+	UART->ENABLE = 0;
+}
+
+static void input_wake_up(void)
+{
+	input_wake = k_cycle_get_32();
+	input_waking = true;
+	input_rx_start();
+}
+
+static void input_sense_isr(const void *arg)
+{
+	/* Pin sense off before the UART takes the pin. */
+	GPIOTE->INTENCLR = GPIOTE_INTENCLR_PORT_Msk;
+	GPIO->PIN_CNF[input_pin] &= ~GPIO_PIN_CNF_SENSE_Msk;
+	GPIOTE->EVENTS_PORT = 0;
+
+	input_wake_up();
+}
+
+static void input_gpio_isr(const struct device *port, struct gpio_callback *cb,
+			   gpio_port_pins_t pins)
+{
+	gpio_pin_interrupt_configure(input_gpio, input_pin, GPIO_INT_DISABLE);
+
+	input_wake_up();
+}
+
+/* PORT events are shared by all pins, another test using pin sense keeps DETECT high. */
+static bool input_sense_free(void)
+{
+	for (int pin = 0; pin < ARRAY_SIZE(GPIO->PIN_CNF); pin++) {
+		if (GPIO->PIN_CNF[pin] & GPIO_PIN_CNF_SENSE_Msk) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void input_sleep(void)
+{
+	if (input_gpio_driver) {
+		/* A low level interrupt uses pin sense in the driver. */
+		input_state = INPUT_SENSE;
+		gpio_pin_interrupt_configure(input_gpio, input_pin, GPIO_INT_LEVEL_LOW);
+		return;
+	}
+
+	if (!input_sense_free()) {
+		input_rx_start();
+		return;
+	}
+
+	input_state = INPUT_SENSE;
+
+	GPIOTE->EVENTS_PORT = 0;
+	GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+	irq_connect_dynamic(GPIOTE1_IRQn, 0, input_sense_isr, NULL, 0);
+	irq_enable(GPIOTE1_IRQn);
+
+	/* The idle line is high, the start bit of the next byte wakes us up. */
+	GPIO->PIN_CNF[input_pin] = (GPIO->PIN_CNF[input_pin] & ~GPIO_PIN_CNF_SENSE_Msk) |
+				   (GPIO_PIN_CNF_SENSE_Low << GPIO_PIN_CNF_SENSE_Pos);
+}
+
+void lp_input_init(bool gpio_driver)
+{
+	input_gpio_driver = gpio_driver;
+	input_pin = UART->PSEL.RXD & UARTE_PSEL_RXD_PIN_Msk;
+
+	if (gpio_driver) {
+		gpio_pin_configure(input_gpio, input_pin, GPIO_INPUT);
+		gpio_init_callback(&input_gpio_cb, input_gpio_isr, BIT(input_pin));
+		gpio_add_callback(input_gpio, &input_gpio_cb);
+	}
+
+	irq_connect_dynamic(SPIM0_SPIS0_TWIM0_TWIS0_UARTE0_IRQn, 0, input_uart_isr, NULL, 0);
+	irq_enable(SPIM0_SPIS0_TWIM0_TWIS0_UARTE0_IRQn);
+}
+
+bool lp_input_active(void)
+{
+	return input_state == INPUT_RX;
+}
+
+/* Wait until a byte is buffered. */
+static void input_wait(void)
+{
+	while (input_tail == input_head) {
+		if (input_state == INPUT_OFF) {
+			input_sleep();
+		}
+
+		if (input_state == INPUT_SENSE) {
+			/* Woken up by the first byte after the sense interrupt. */
+			k_sem_take(&input_data, K_FOREVER);
+		} else if (k_sem_take(&input_data, K_MSEC(INPUT_IDLE_MS)) &&
+			   input_tail == input_head) {
+			input_rx_stop();
+		}
+	}
+}
+
+uint8_t lp_get(void)
+{
+	uint8_t input;
+
+	do {
+		input_wait();
+		input = input_ring[input_tail % INPUT_RING_SIZE];
+		input_tail++;
+	} while (input == '\r' || input == '\n');
+
+	return input;
+}
+
+int lp_get_line(char *line, int size)
+{
+	int len = 0;
+
+	while (1) {
+		uint8_t input;
+
+		input_wait();
+		input = input_ring[input_tail % INPUT_RING_SIZE];
+		input_tail++;
+
+		if (input == '\r' || input == '\n') {
+			if (len) {
+				break;
+			}
+		} else if (input == '\b' || input == 0x7f) {
+			if (len) {
+				len--;
+			}
+		} else if (len < size - 1) {
+			line[len++] = input;
+		}
+	}
+
+	line[len] = '\0';
+
+	return len;
+}
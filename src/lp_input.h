@@ -0,0 +1,31 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef LP_INPUT_H_
+#define LP_INPUT_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/* Interrupt driven console input on UARTE0. Received bytes are buffered while receive is on,
+ * after a few seconds without input UARTE0 is disabled and the CPU sleeps until the RXD pin
+ * goes low, the byte that wakes the console is dropped. The pin sense interrupt is connected
+ * directly, or with 'gpio_driver' goes through the Zephyr GPIO driver for builds where Zephyr
+ * drivers own the GPIOTE1 interrupt.
+ */
+void lp_input_init(bool gpio_driver);
+
+/* True while UARTE0 is receiving, it must not be disabled after console output then. */
+bool lp_input_active(void);
+
+/* Next key, carriage return and line feed are skipped. */
+uint8_t lp_get(void);
+
+/* Read a line without the line ending, returns its length. */
+int lp_get_line(char *line, int size);
+
+#endif /* LP_INPUT_H_ */
@@ -0,0 +1,312 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+
+#include "lp_input.h"
+#include "lp_log.h"
+
+#define UART NRF_UARTE0_NS
+
+/* A record is the format string, the number of arguments and the arguments, one slot each. */
+#define LOG_SLOTS      1024
+#define LOG_MAX_ARGS   16
+#define LOG_TEXT_SIZE  2048
+#define LOG_SPEC_SIZE  16
+
+static uint64_t log_slots[LOG_SLOTS];
+static int log_used;
+static int log_dropped;
+static bool log_active;
+
+/* Formatted text of a flush, sent by DMA so it has to be in RAM. */
+static char log_text[LOG_TEXT_SIZE];
+static int log_text_len;
+
+enum arg_type {
+	ARG_NONE,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LONG_LONG,
+	ARG_POINTER,
+	ARG_DOUBLE,
+};
+
+/* Parse the conversion at 'fmt' (just after the '%'), returns the end of it. 'stars' is the
+ * number of '*' width and precision arguments in front of the value.
+ */
+static const char *parse_spec(const char *fmt, int *stars, enum arg_type *type)
+{
+	int longs = 0;
+
+	*stars = 0;
+
+	while (*fmt && strchr("-+ #0", *fmt)) {
+		fmt++;
+	}
+	while (*fmt && strchr("0123456789.*", *fmt)) {
+		if (*fmt == '*') {
+			(*stars)++;
+		}
+		fmt++;
+	}
+	while (*fmt && strchr("hlLqjzt", *fmt)) {
+		if (*fmt == 'l' || *fmt == 'q' || *fmt == 'j') {
+			longs++;
+		}
+		fmt++;
+	}
+
+	switch (*fmt) {
+	case 'd': case 'i': case 'o': case 'u': case 'x': case 'X':
+		*type = longs >= 2 ? ARG_LONG_LONG : longs ? ARG_LONG : ARG_INT;
+		break;
+	case 'c':
+		*type = ARG_INT;
+		break;
+	case 's': case 'p':
+		*type = ARG_POINTER;
+		break;
+	case 'e': case 'E': case 'f': case 'F': case 'g': case 'G': case 'a': case 'A':
+		*type = ARG_DOUBLE;
+		break;
+	default:
+		/* "%%" and anything not supported. */
+		*type = ARG_NONE;
+		break;
+	}
+
+	return *fmt ? fmt + 1 : fmt;
+}
+
+void lp_log_begin(void)
+{
+	log_used = 0;
+	log_dropped = 0;
+	log_active = true;
+}
+
+bool lp_log_active(void)
+{
+	return log_active;
+}
+
+void lp_log_record(const char *fmt, va_list args)
+{
+	uint64_t values[LOG_MAX_ARGS];
+	int count = 0;
+	const char *p = fmt;
+
+	while ((p = strchr(p, '%')) != NULL) {
+		enum arg_type type;
+		int stars;
+
+		p = parse_spec(p + 1, &stars, &type);
+		if (type == ARG_NONE) {
+			continue;
+		}
+		if (count + stars + 1 > LOG_MAX_ARGS) {
+			break;
+		}
+		while (stars--) {
+			values[count++] = va_arg(args, int);
+		}
+		switch (type) {
+		case ARG_INT:
+			values[count++] = va_arg(args, unsigned int);
+			break;
+		case ARG_LONG:
+			values[count++] = va_arg(args, unsigned long);
+			break;
+		case ARG_LONG_LONG:
+			values[count++] = va_arg(args, unsigned long long);
+			break;
+		case ARG_POINTER:
+			values[count++] = (uintptr_t)va_arg(args, void *);
+			break;
+		case ARG_DOUBLE: {
+			double value = va_arg(args, double);
+
+			memcpy(&values[count++], &value, sizeof(value));
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	/* Tests print their report after the measurement or flush first, a built-in test
+	 * never fills the log.
+	 */
+	__ASSERT(log_used + 2 + count <= LOG_SLOTS, "Deferred log full, flush after the measurement");
+	if (log_used + 2 + count > LOG_SLOTS) {
+		log_dropped++;
+		return;
+	}
+
+	log_slots[log_used++] = (uintptr_t)fmt;
+	log_slots[log_used++] = count;
+	memcpy(&log_slots[log_used], values, count * sizeof(values[0]));
+	log_used += count;
+}
+
+/* Send the formatted text with a single DMA transfer. */
+static void log_send(void)
+{
+	if (!log_text_len) {
+		return;
+	}
+
+	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+
+	UART->TXD.PTR = (int)log_text;
+	UART->TXD.MAXCNT = log_text_len;
+	UART->EVENTS_ENDTX = 0;
+	UART->TASKS_STARTTX = 1;
+
+	while (!UART->EVENTS_ENDTX) {
+		usleep(1000);
+	}
+
+	if (!lp_input_active()) {
+		UART->ENABLE = 0;
+	}
+
+	log_text_len = 0;
+}
+
+static void log_append(const char *text, int len)
+{
+	while (len > 0) {
+		int chunk = MIN(len, LOG_TEXT_SIZE - log_text_len);
+
+		memcpy(&log_text[log_text_len], text, chunk);
+		log_text_len += chunk;
+		text += chunk;
+		len -= chunk;
+
+		if (log_text_len == LOG_TEXT_SIZE) {
+			log_send();
+		}
+	}
+}
+
+/* Format one conversion, 'values' starts at its '*' arguments. */
+static void log_format_spec(const char *spec, int stars, enum arg_type type,
+			    const uint64_t *values)
+{
+	char text[128];
+	int width = stars > 0 ? (int)values[0] : 0;
+	int precision = stars > 1 ? (int)values[1] : 0;
+	uint64_t value = values[stars];
+	double number;
+	int len;
+
+	memcpy(&number, &value, sizeof(number));
+
+#define LOG_FORMAT(arg)								\
+	(stars == 2 ? snprintf(text, sizeof(text), spec, width, precision, arg) :	\
+	 stars == 1 ? snprintf(text, sizeof(text), spec, width, arg) :		\
+		      snprintf(text, sizeof(text), spec, arg))
+
+	switch (type) {
+	case ARG_INT:
+		len = LOG_FORMAT((unsigned int)value);
+		break;
+	case ARG_LONG:
+		len = LOG_FORMAT((unsigned long)value);
+		break;
+	case ARG_LONG_LONG:
+		len = LOG_FORMAT((unsigned long long)value);
+		break;
+	case ARG_POINTER:
+		/* Strings can be longer than the local buffer. */
+		if (spec[strlen(spec) - 1] == 's' && stars == 0 && !strpbrk(spec, "0123456789.")) {
+			log_append((const char *)(uintptr_t)value,
+				   strlen((const char *)(uintptr_t)value));
+			return;
+		}
+		len = LOG_FORMAT((void *)(uintptr_t)value);
+		break;
+	case ARG_DOUBLE:
+		len = LOG_FORMAT(number);
+		break;
+	default:
+		len = 0;
+		break;
+	}
+
+#undef LOG_FORMAT
+
+	log_append(text, MIN(len, (int)sizeof(text) - 1));
+}
+
+static void log_format(const char *fmt, const uint64_t *values, int count)
+{
+	const char *p = fmt;
+	int used = 0;
+
+	while (*p) {
+		const char *start = strchr(p, '%');
+		char spec[LOG_SPEC_SIZE];
+		enum arg_type type;
+		int stars;
+
+		if (!start) {
+			log_append(p, strlen(p));
+			break;
+		}
+		log_append(p, start - p);
+
+		p = parse_spec(start + 1, &stars, &type);
+		if (type == ARG_NONE) {
+			if (p[-1] == '%') {
+				log_append("%", 1);
+			}
+			continue;
+		}
+		if (used + stars + 1 > count || p - start >= sizeof(spec)) {
+			/* Arguments that didn't fit in the record. */
+			log_append(start, p - start);
+			continue;
+		}
+
+		memcpy(spec, start, p - start);
+		spec[p - start] = '\0';
+		log_format_spec(spec, stars, type, &values[used]);
+		used += stars + 1;
+	}
+}
+
+void lp_log_flush(void)
+{
+	int pos = 0;
+
+	log_active = false;
+
+	while (pos < log_used) {
+		const char *fmt = (const char *)(uintptr_t)log_slots[pos];
+		int count = log_slots[pos + 1];
+
+		log_format(fmt, &log_slots[pos + 2], count);
+		pos += 2 + count;
+	}
+	log_used = 0;
+
+	if (log_dropped) {
+		char text[48];
+
+		log_append(text, snprintf(text, sizeof(text), "%d messages dropped\n",
+					  log_dropped));
+		log_dropped = 0;
+	}
+
+	log_send();
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef LP_LOG_H_
+#define LP_LOG_H_
+
+#include <stdarg.h>
+#include <stdbool.h>
+
+/* Deferred console output. Between lp_log_begin() and lp_log_flush() lp_printf() only stores
+ * the format string and its arguments in RAM, nothing is formatted and UARTE0 stays disabled.
+ * The flush formats all records and sends them in as few UARTE0 DMA transfers as possible.
+ * String arguments must still be valid at the flush.
+ */
+void lp_log_begin(void);
+bool lp_log_active(void);
+void lp_log_record(const char *fmt, va_list args);
+void lp_log_flush(void);
+
+#endif /* LP_LOG_H_ */
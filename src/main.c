@@ -6,24 +6,41 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <unistd.h>
 #include <zephyr/kernel.h>
 #include <zephyr/logging/log.h>
 #include <modem/nrf_modem_lib.h>
 
-#define RED	"\e[0;31m"
-#define GREEN	"\e[0;32m"
-#define NORMAL	"\e[0m"
+#include "bus.h"
+#include "frame.h"
+#include "lp_input.h"
+#include "lp_log.h"
+#include "pattern.h"
+#include "stats.h"
+#include "term_color.h"
+#include "xfer_timing.h"
 
 uint8_t tx_buffer[8*1024];
 uint8_t rx_buffer[8*1024];
 
+/* Power mode selected in the menu, low power after reset. */
+bool constant_latency;
+
 /* Keeping UARTE0 on drains a bit of power */
 int lp_printf(const char *fmt, ...)
 {
 	va_list args;
 	int ret;
 
+	/* Printed by lp_log_flush() after the measurement. */
+	if (lp_log_active()) {
+		va_start(args, fmt);
+		lp_log_record(fmt, args);
+		va_end(args);
+		return 0;
+	}
+
 	NRF_UARTE0_NS->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
 
 	va_start(args, fmt);
@@ -33,13 +50,38 @@ int lp_printf(const char *fmt, ...)
 	while (!NRF_UARTE0_NS->EVENTS_ENDTX) {
 		usleep(1000);
 	}
-	NRF_UARTE0_NS->ENABLE = 0;
+	if (!lp_input_active()) {
+		NRF_UARTE0_NS->ENABLE = 0;
+	}
 
 	return ret;
 }
 
+/* Fill tx_buffer with the incrementing test pattern again after a test overwrote it. */
+void tx_pattern_restore(void)
+{
+	struct pattern pattern;
+
+	pattern_init(&pattern, PATTERN_INCREMENT);
+	pattern_fill(&pattern, tx_buffer, sizeof(tx_buffer));
+}
+
+/* Index of the first byte not matching the test pattern, -1 if all match. */
+int rx_first_error(int received)
+{
+	for (int i = 2; i < received; i++) {
+		if (rx_buffer[i] != (i & 0xff)) {
+			return i;
+		}
+	}
+
+	return -1;
+}
+
 void lp_print_rx(int received, int expected)
 {
+	int error;
+
 	lp_printf("Received %d bytes %02x%02x%02x%02x %02x%02x%02x%02x ... ", received,
 			rx_buffer[0], rx_buffer[1], rx_buffer[2], rx_buffer[3],
 			rx_buffer[4], rx_buffer[5], rx_buffer[6], rx_buffer[7]);
@@ -56,37 +98,20 @@ void lp_print_rx(int received, int expected)
 		return;
 	}
 
-	for (int i = 2; i < received; i++) {
-		if (rx_buffer[i] != (i & 0xff)) {
-			lp_printf(RED "Mismatch in byte %d" NORMAL" expected %02x got %02x\n", i,
-				  i & 0xff, rx_buffer[i]);
-			return;
-		}
-	}
-
-	lp_printf(GREEN "OK\n" NORMAL);
-}
-
-uint8_t lp_get(void)
-{
-	static uint8_t input;
-
-	NRF_UARTE0_NS->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+	error = rx_first_error(received);
+	if (error >= 0) {
+		struct pattern pattern;
 
-	NRF_UARTE0_NS->RXD.PTR = (int)&input;
-	NRF_UARTE0_NS->RXD.MAXCNT = 1;
-	NRF_UARTE0_NS->EVENTS_ENDRX = 0;
-	NRF_UARTE0_NS->TASKS_STARTRX = 1;
-
-	while (!NRF_UARTE0_NS->EVENTS_ENDRX) {
-		usleep(100000);
+		/* The header replaces the first two bytes of the counting pattern. */
+		pattern_init(&pattern, PATTERN_INCREMENT);
+		pattern_skip(&pattern, 2);
+		lp_printf(RED "Mismatch in byte %d" NORMAL" expected %02x got %02x, %u bit errors\n",
+			  error, error & 0xff, rx_buffer[error],
+			  pattern_check(&pattern, &rx_buffer[2], received - 2));
+		return;
 	}
 
-	NRF_UARTE0_NS->TASKS_STOPRX = 1;
-
-	NRF_UARTE0_NS->ENABLE = 0;
-
-	return input;
+	lp_printf(GREEN "OK\n" NORMAL);
 }
 
 #if DT_NODE_EXISTS(DT_NODELABEL(spi_master))
@@ -101,7 +126,9 @@ uint8_t lp_get(void)
 
 #elif DT_NODE_EXISTS(DT_NODELABEL(uart))
 
-/* west build -b nrf9151dk/nrf9151/ns --pristine -- -DDTC_OVERLAY_FILE=boards/uart.overlay */
+/* west build -b nrf9151dk/nrf9151/ns --pristine -- -DDTC_OVERLAY_FILE=boards/uart.overlay \
+ * -DEXTRA_CONF_FILE=boards/uart.conf
+ */
 #include "uart_dt.c"
 
 #elif DT_NODE_EXISTS(DT_NODELABEL(uart_lp))
@@ -131,39 +158,97 @@ int spim_send(int size);
 int spim_send_delayed(int size);
 int spim_recv(int size);
 int spim_recv_delayed(int size);
+int spim_transceive(int tx_size, int rx_size);
+void spim_hw_cs_init(uint32_t bitrate);
+int spim_send_hw_cs(int size);
+int spim_recv_hw_cs(int size);
+void spim_hw_cs_deinit(void);
+int spim_burst_send(int size);
+int spim_burst_recv(int size);
+int spim_stream_send(int size);
+int spim_stream_recv(int size);
+int spim_ber(int size);
 void spim_deinit(void);
 
 void spis_init(uint32_t bitrate);
 int spis_send(int size);
+int spis_transceive(int tx_size, int rx_size);
+int spis_stream_send(int size);
+int spis_stream_recv(int size);
 int spis_recv(int size);
 void spis_deinit(void);
 
 void uart_init(uint32_t bitrate);
 int uart_send(int size);
 int uart_recv(int size);
+int uart_stream_send(int size);
+int uart_stream_recv(int size);
 void uart_deinit(void);
 
 void uart_timeout_init(uint32_t bitrate);
+void uart_timeout_chars_init(uint32_t bitrate);
+int uart_timeout_recv(int size);
 void uart_timeout_deinit(void);
 
 void uart_lp_init(uint32_t bitrate);
 int uart_lp_send(int size);
 int uart_lp_recv(int size);
+void uart_session_init(uint32_t bitrate);
+int uart_session_send(int size);
+int uart_session_recv(int size);
 
 void twim_init(uint32_t bitrate);
 int twim_send(int size);
 int twim_recv(int size);
 void twim_deinit(void);
+int twim_write_read(int tx_size, int rx_size);
+int twim_register_bench(int size);
 
 void twis_init(uint32_t bitrate);
 int twis_send(int size);
 int twis_recv(int size);
 void twis_deinit(void);
+int twis_transceive(int tx_size, int rx_size);
+void twis_prearmed_init(uint32_t bitrate);
+
+void loop_spi_init(uint32_t bitrate);
+int loop_spi_send(int size);
+int loop_spi_recv(int size);
+int loop_spi_transceive(int tx_size, int rx_size);
+void loop_spi_deinit(void);
+void loop_uart_init(uint32_t bitrate);
+int loop_uart_send(int size);
+int loop_uart_recv(int size);
+void loop_uart_deinit(void);
+void loop_twi_init(uint32_t bitrate);
+int loop_twi_send(int size);
+int loop_twi_recv(int size);
+int loop_twi_transceive(int tx_size, int rx_size);
+void loop_twi_deinit(void);
+void multibus_init(uint32_t bitrate);
+int multibus_send(int size);
+int multibus_recv(int size);
+void multibus_deinit(void);
+void irq_bench_init(uint32_t bitrate);
+int irq_bench(int size);
+void irq_bench_deinit(void);
 
 void gpio_init(uint32_t bitrate);
 int gpio_send(int size);
 int gpio_recv(int size);
 void gpio_deinit(void);
+void gpio_hist_init(uint32_t bitrate);
+int gpio_histogram(int size);
+void gpio_hist_deinit(void);
+void spim_dt_init(uint32_t bitrate);
+int spim_dt_send(int size);
+int spim_dt_recv(int size);
+int spim_dt_transceive(int tx_size, int rx_size);
+void spim_dt_deinit(void);
+void spim_ab_init(uint32_t bitrate);
+int spim_ab_send(int size);
+int spim_ab_recv(int size);
+void spim_ab_deinit(void);
 
 int no_send(int size)
 {
@@ -183,6 +268,7 @@ void no_deinit(void)
 int (*send)(int size) = no_send;
 int (*recv)(int size) = no_recv;
 void (*deinit)(void) = no_deinit;
+int (*transceive)(int tx_size, int rx_size);
 
 typedef struct {
 	char *label;
@@ -191,95 +277,191 @@ typedef struct {
 	int (*send)(int);
 	int (*recv)(int);
 	void (*deinit)(void);
+	bool no_sweep;		/* Doesn't run fixed size transfers. */
+	int (*transceive)(int, int);	/* Full-duplex, NULL if not supported. */
 } device_option_t;
 
+static const device_option_t device_menu[] = {
+	{"None (measure idle power)", NULL, 0, no_send, no_recv, no_deinit, true},
+	{"SPI master @ 125 kbps with increased CSN to CLK delay", spim_init,
+			SPIM_FREQUENCY_FREQUENCY_K125,
+			spim_send_delayed, spim_recv_delayed, spim_deinit},
+	{"SPI master @ 1 Mbps with increased CSN to CLK delay", spim_init,
+			SPIM_FREQUENCY_FREQUENCY_M1,
+			spim_send_delayed, spim_recv_delayed, spim_deinit},
+	{"SPI master @ 1 Mbps", spim_init, SPIM_FREQUENCY_FREQUENCY_M1,
+			spim_send, spim_recv, spim_deinit, false, spim_transceive},
+	{"SPI master @ 8 Mbps", spim_init, SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_send, spim_recv, spim_deinit, false, spim_transceive},
+	{"SPI master @ 8 Mbps with increased CSN to CLK delay", spim_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_send_delayed, spim_recv_delayed, spim_deinit},
+	{"SPI master @ 1 Mbps with hardware timed CSN to CLK delay", spim_hw_cs_init,
+			SPIM_FREQUENCY_FREQUENCY_M1,
+			spim_send_hw_cs, spim_recv_hw_cs, spim_hw_cs_deinit},
+	{"SPI master @ 8 Mbps with hardware timed CSN to CLK delay", spim_hw_cs_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_send_hw_cs, spim_recv_hw_cs, spim_hw_cs_deinit},
+	{"SPI master back-to-back frames @ 8 Mbps", spim_hw_cs_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_burst_send, spim_burst_recv, spim_hw_cs_deinit, true},
+	{"SPI master streaming at all frequencies", spim_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_stream_send, spim_stream_recv, spim_deinit, true},
+	{"SPI master BER soak @ 8 Mbps, MOSI to MISO", spim_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_ber, spim_ber, spim_deinit, true},
+#if DT_NODE_EXISTS(DT_NODELABEL(spi_master_ab))
+	{"SPI master @ 8 Mbps, Zephyr driver", spim_dt_init, SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_dt_send, spim_dt_recv, spim_dt_deinit, false, spim_dt_transceive},
+	{"SPI master bare vs Zephyr driver @ 8 Mbps", spim_ab_init,
+			SPIM_FREQUENCY_FREQUENCY_M8,
+			spim_ab_send, spim_ab_recv, spim_ab_deinit, true},
+#endif
+	{"SPI slave", spis_init, 0, spis_send, spis_recv, spis_deinit, false, spis_transceive},
+	{"SPI slave back-to-back frames", spis_init, 0, spis_stream_send, spis_stream_recv,
+			spis_deinit, true},
+	{"UART @ 115.2 kbps", uart_init, UARTE_BAUDRATE_BAUDRATE_Baud115200,
+			uart_send, uart_recv, uart_deinit},
+	{"UART @ 1 Mbps", uart_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_send, uart_recv, uart_deinit},
+	{"UART @ 2 Mbps", uart_init, UART_BAUDRATE(2000000),
+			uart_send, uart_recv, uart_deinit},
+	{"UART streaming @ 1 Mbps", uart_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_stream_send, uart_stream_recv, uart_deinit, true},
+	{"UART streaming @ 2 Mbps", uart_init, UART_BAUDRATE(2000000),
+			uart_stream_send, uart_stream_recv, uart_deinit, true},
+	{"UART with RX timeout @ 1 Mbps", uart_timeout_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_send, uart_timeout_recv, uart_timeout_deinit},
+	{"UART with RX timeout in character times @ 115.2 kbps", uart_timeout_chars_init,
+			UARTE_BAUDRATE_BAUDRATE_Baud115200,
+			uart_send, uart_timeout_recv, uart_timeout_deinit},
+	{"UART with RX timeout in character times @ 1 Mbps", uart_timeout_chars_init,
+			UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_send, uart_timeout_recv, uart_timeout_deinit},
+	{"UART with enable pins @ 1 Mbps", uart_lp_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_lp_send, uart_lp_recv, uart_deinit, true},
+	{"UART sessions, either side wakes the link @ 1 Mbps", uart_session_init,
+			UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			uart_session_send, uart_session_recv, uart_deinit, true},
+	{"TWI master @ 100 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K100,
+			twim_send, twim_recv, twim_deinit, false, twim_write_read},
+	{"TWI master @ 250 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K250,
+			twim_send, twim_recv, twim_deinit, false, twim_write_read},
+	{"TWI master @ 400 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K400,
+			twim_send, twim_recv, twim_deinit, false, twim_write_read},
+	{"TWI master register reads at all frequencies", twim_init, TWIM_FREQUENCY_FREQUENCY_K100,
+			twim_register_bench, twim_register_bench, twim_deinit, true},
+	{"TWI slave", twis_init, 0, twis_send, twis_recv, twis_deinit, false, twis_transceive},
+	{"TWI slave with pre-armed buffers", twis_prearmed_init, 0, twis_send, twis_recv,
+			twis_deinit, false, twis_transceive},
+	{"Loopback SPIM1 to SPIS2 @ 8 Mbps", loop_spi_init, SPIM_FREQUENCY_FREQUENCY_M8,
+			loop_spi_send, loop_spi_recv, loop_spi_deinit, false, loop_spi_transceive},
+	{"Loopback UARTE1 to UARTE2 @ 1 Mbps", loop_uart_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			loop_uart_send, loop_uart_recv, loop_uart_deinit},
+	{"Loopback TWIM1 to TWIS2 @ 400 kbps", loop_twi_init, TWIM_FREQUENCY_FREQUENCY_K400,
+			loop_twi_send, loop_twi_recv, loop_twi_deinit, false, loop_twi_transceive},
+	{"Concurrent SPIM1 + SPIM3 + UARTE2", multibus_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
+			multibus_send, multibus_recv, multibus_deinit, true},
+	{"GPIO interrupt response timing", gpio_init, 0, gpio_send, gpio_recv, gpio_deinit, true},
+	{"GPIO interrupt latency histogram", gpio_hist_init, 0, gpio_histogram, gpio_histogram,
+			gpio_hist_deinit, true},
+	{"Interrupt latency of dynamic, static and direct ISRs", irq_bench_init, 0,
+			irq_bench, irq_bench, irq_bench_deinit, true},
+};
+
+/* Menu keys of the devices, in order. */
+static const char device_keys[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
+
+BUILD_ASSERT(ARRAY_SIZE(device_menu) <= sizeof(device_keys) - 1);
+
+static void sweep(void);
+static void command(void);
+
 char *select_device(void)
 {
+	const char *pos;
 	char input;
 	int index;
-	device_option_t device_menu[] = {
-		{"None (measure idle power)", NULL, 0, no_send, no_recv, no_deinit},
-		{"SPI master @ 125 kbps with increased CSN to CLK delay", spim_init,
-				SPIM_FREQUENCY_FREQUENCY_K125,
-				spim_send_delayed, spim_recv_delayed, spim_deinit},
-		{"SPI master @ 1 Mbps with increased CSN to CLK delay", spim_init,
-				SPIM_FREQUENCY_FREQUENCY_M1,
-				spim_send_delayed, spim_recv_delayed, spim_deinit},
-		{"SPI master @ 1 Mbps", spim_init, SPIM_FREQUENCY_FREQUENCY_M1,
-				spim_send, spim_recv, spim_deinit},
-		{"SPI master @ 8 Mbps with increased CSN to CLK delay", spim_init,
-				SPIM_FREQUENCY_FREQUENCY_M8,
-				spim_send_delayed, spim_recv_delayed, spim_deinit},
-		{"SPI slave", spis_init, 0, spis_send, spis_recv, spis_deinit},
-		{"UART @ 115.2 kbps", uart_init, UARTE_BAUDRATE_BAUDRATE_Baud115200,
-				uart_send, uart_recv, uart_deinit},
-		{"UART @ 1 Mbps", uart_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
-				uart_send, uart_recv, uart_deinit},
-		{"UART @ 2 Mbps", uart_init, 2 * UARTE_BAUDRATE_BAUDRATE_Baud1M,
-				uart_send, uart_recv, uart_deinit},
-		{"UART with RX timeout @ 1 Mbps", uart_timeout_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
-				uart_send, uart_recv, uart_timeout_deinit},
-		{"UART with enable pins @ 1 Mbps", uart_lp_init, UARTE_BAUDRATE_BAUDRATE_Baud1M,
-				uart_lp_send, uart_lp_recv, uart_deinit},
-		{"TWI master @ 100 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K100,
-				twim_send, twim_recv, twim_deinit},
-		{"TWI master @ 250 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K250,
-				twim_send, twim_recv, twim_deinit},
-		{"TWI master @ 400 kbps", twim_init, TWIM_FREQUENCY_FREQUENCY_K400,
-				twim_send, twim_recv, twim_deinit},
-		{"TWI slave", twis_init, 0, twis_send, twis_recv, twis_deinit},
-		{"GPIO interrupt response timing", gpio_init, 0, gpio_send, gpio_recv, gpio_deinit},
-	};
 
 	lp_printf("\nSelect peripheral:\n");
 	for (index = 0; index < ARRAY_SIZE(device_menu); index++) {
-		lp_printf("  %c. %s\n", 'a' + index, device_menu[index].label);
+		lp_printf("  %c. %s\n", device_keys[index], device_menu[index].label);
 	}
 
 	lp_printf("Configuration:\n");
 	lp_printf("  [. Constant latency (keep clock on)\n");
 	lp_printf("  ]. Low power mode (disable clock while idle)\n");
+	lp_printf("Automation:\n");
+	lp_printf("  *. Sweep all devices, sizes and directions (CSV output)\n");
+	lp_printf("  :. Run a device at any bitrate, size and repetition count (CSV output)\n");
 
 	input = lp_get();
 
 	if (input == '[') {
 		lp_printf("Switching to Constant latency mode\n", input);
 		NRF_POWER_NS->TASKS_CONSTLAT = 1;
+		constant_latency = true;
 		return "";
 	}
 	if (input == ']') {
 		lp_printf("Switching to low power mode\n", input);
 		NRF_POWER_NS->TASKS_LOWPWR = 1;
+		constant_latency = false;
+		return "";
+	}
+	if (input == '*') {
+		sweep();
+		return "";
+	}
+	if (input == ':') {
+		command();
 		return "";
 	}
-	if (input < 'a' || input >= 'a' + ARRAY_SIZE(device_menu)) {
+	pos = input ? strchr(device_keys, input) : NULL;
+	if (!pos || pos - device_keys >= ARRAY_SIZE(device_menu)) {
 		lp_printf("Invalid selection '%c'\n", input);
 		return "";
 	}
 
-	index = input - 'a';
+	index = pos - device_keys;
 
 	lp_printf("Selected device '%s'\n", device_menu[index].label);
 
 	if (device_menu[index].init) {
+		lp_log_begin();
 		device_menu[index].init(device_menu[index].bitrate);
+		lp_log_flush();
 	}
 	send = device_menu[index].send;
 	recv = device_menu[index].recv;
 	deinit = device_menu[index].deinit;
+	transceive = device_menu[index].transceive;
 
 	return device_menu[index].label;
 }
 
 #endif
 
+#ifdef HAVE_TRANSCEIVE
+#define transceive_supported() true
+#else
+#ifndef RAW_TEST
+/* The device tree backend can't send and receive at the same time. */
+static int (*const transceive)(int tx_size, int rx_size);
+#endif
+#define transceive_supported() (transceive != NULL)
+#endif
 
 typedef struct {
 	const char *label;
 	int size;
 	int (*func)(int);
+	int rx_size;		/* Full-duplex test receiving rx_size while sending size. */
 } test_option_t;
 
+static const char test_keys[] = "1234567890abcdefghij";
+
 int sleep_10(int size)
 {
 	return sleep(10);
@@ -292,8 +474,211 @@ int set_size_and_send(int size)
 	return send(size);
 }
 
+int set_size_and_transceive(int tx_size, int rx_size)
+{
+	if (!transceive_supported()) {
+		return -ENOTSUP;
+	}
+
+	tx_buffer[0] = tx_size >> 8;
+	tx_buffer[1] = tx_size & 0xff;
+	return transceive(tx_size, rx_size);
+}
+
+/* Send a message and receive the echo 'CONFIG_PINGPONG_ITERATIONS' times. Every round trip is
+ * its own transfer timing measurement, run_test() prints no timing for a test returning 0.
+ */
+int pingpong(int size)
+{
+	static uint32_t rtt[CONFIG_PINGPONG_ITERATIONS];
+	struct stats stats;
+	int errors = 0;
+	int count;
+
+	for (count = 0; count < CONFIG_PINGPONG_ITERATIONS; count++) {
+		struct xfer_timing timing;
+		int ret;
+
+		xfer_timing_begin();
+		ret = set_size_and_send(size);
+		if (ret == size) {
+			k_busy_wait(CONFIG_PINGPONG_TURNAROUND_US);
+			ret = recv(size);
+		}
+		xfer_timing_end(&timing);
+		rtt[count] = timing.total_us;
+
+		if (ret == -ETIMEDOUT) {
+			break;
+		}
+		if (ret != size || (rx_buffer[0] << 8) + rx_buffer[1] != size ||
+		    rx_first_error(ret) >= 0) {
+			errors++;
+		}
+
+		/* Let the echo side re-arm. */
+		k_msleep(1);
+	}
+
+	if (!count) {
+		return -ETIMEDOUT;
+	}
+
+	stats_calc(rtt, count, &stats);
+	lp_printf("%d round trips of %d bytes, ", count, size);
+	if (errors) {
+		lp_printf(RED "%d errors" NORMAL, errors);
+	} else {
+		lp_printf(GREEN "no errors" NORMAL);
+	}
+	lp_printf("\n    RTT min %u p50 %u p90 %u p99 %u max %u us\n",
+		  stats.min, stats.p50, stats.p90, stats.p99, stats.max);
+
+	return 0;
+}
+
+/* Answer every received message with the same bytes until the peer stops sending. */
+int echo(int size)
+{
+	int count;
+
+	for (count = 0; count < CONFIG_PINGPONG_ITERATIONS; count++) {
+		int ret = recv(size);
+
+		if (ret <= 0) {
+			break;
+		}
+		memcpy(tx_buffer, rx_buffer, ret);
+		if (send(ret) != ret) {
+			break;
+		}
+	}
+
+	tx_pattern_restore();
+
+	lp_printf("Echoed %d messages\n", count);
+
+	return count ? 0 : -ETIMEDOUT;
+}
+
+/* Frames of 'payload_size' bytes packed into one transfer, the same on both sides. */
+static int frame_window(int payload_size)
+{
+	return CLAMP(sizeof(tx_buffer) / (payload_size + FRAME_OVERHEAD), 1, CONFIG_FRAME_WINDOW);
+}
+
+static void print_goodput(uint64_t raw_bytes, uint64_t payload_bytes, uint32_t us)
+{
+	if (!us) {
+		return;
+	}
+	lp_printf("    Raw %llu bytes/s, goodput %llu bytes/s (%llu%%)\n",
+		  raw_bytes * 1000000 / us, payload_bytes * 1000000 / us,
+		  raw_bytes ? payload_bytes * 100 / raw_bytes : 0);
+}
+
+/* Send 'CONFIG_FRAME_TRANSFERS' transfers, each with a window of frames numbered without
+ * waiting for the receiver in between. Only the time in send() counts.
+ */
+int framed_send(int payload_size)
+{
+	int window = frame_window(payload_size);
+	int transfer_size = window * (payload_size + FRAME_OVERHEAD);
+	uint64_t raw_bytes = 0;
+	uint32_t cycles = 0;
+	uint16_t seq = 0;
+	int count;
+
+	for (count = 0; count < CONFIG_FRAME_TRANSFERS; count++) {
+		uint32_t start;
+		int offset = 0;
+		int ret;
+
+		for (int i = 0; i < window; i++) {
+			offset += frame_build(&tx_buffer[offset], seq++, payload_size);
+		}
+
+		start = k_cycle_get_32();
+		ret = send(transfer_size);
+		cycles += k_cycle_get_32() - start;
+
+		if (ret != transfer_size) {
+			break;
+		}
+		raw_bytes += ret;
+
+		/* Let the receiver re-arm. */
+		k_msleep(1);
+	}
+
+	tx_pattern_restore();
+
+	lp_printf("Sent %d transfers of %d frames with %d bytes payload\n", count, window,
+		  payload_size);
+	print_goodput(raw_bytes, raw_bytes / (payload_size + FRAME_OVERHEAD) * payload_size,
+		      k_cyc_to_us_floor32(cycles));
+
+	return count ? 0 : -ETIMEDOUT;
+}
+
+/* Receive the transfers of framed_send() and check every frame. The rates are taken from the
+ * end of the first transfer to the end of the last one, so they include the gaps of the sender.
+ */
+int framed_recv(int payload_size)
+{
+	int transfer_size = frame_window(payload_size) * (payload_size + FRAME_OVERHEAD);
+	struct frame_rx_stats stats = {0};
+	uint64_t raw_bytes = 0;
+	uint64_t first_payload = 0;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	int count;
+
+	for (count = 0; count < CONFIG_FRAME_TRANSFERS; count++) {
+		int ret = recv(transfer_size);
+
+		if (ret <= 0) {
+			break;
+		}
+		last = k_cycle_get_32();
+		frame_parse(rx_buffer, ret, &stats);
+
+		if (count) {
+			raw_bytes += ret;
+		} else {
+			first = last;
+			first_payload = stats.payload_bytes;
+		}
+	}
+
+	lp_printf("Received %d transfers, %u frames, ", count, stats.frames);
+	if (stats.lost || stats.duplicated || stats.corrupted) {
+		lp_printf(RED "%u lost, %u duplicated, %u corrupted" NORMAL "\n", stats.lost,
+			  stats.duplicated, stats.corrupted);
+	} else {
+		lp_printf(GREEN "no errors" NORMAL "\n");
+	}
+	print_goodput(raw_bytes, stats.payload_bytes - first_payload,
+		      k_cyc_to_us_floor32(last - first));
+
+	return count ? 0 : -ETIMEDOUT;
+}
+
+void print_timing(int bytes, const struct xfer_timing *timing)
+{
+	lp_printf("    Before start %u us, wire %u us, after end %u us\n",
+		  timing->pre_us, timing->wire_us, timing->post_us);
+
+	if (bytes > 0 && timing->wire_us && timing->total_us) {
+		lp_printf("    %u bytes/s on the wire, %u bytes/s effective\n",
+			  (uint32_t)((uint64_t)bytes * 1000000 / timing->wire_us),
+			  (uint32_t)((uint64_t)bytes * 1000000 / timing->total_us));
+	}
+}
+
 bool run_test(void)
 {
+	struct xfer_timing timing;
 	int ret;
 	int input;
 	test_option_t test_menu[] = {
@@ -304,55 +689,401 @@ bool run_test(void)
 		{"Receive 16 bytes", 16, recv},
 		{"Receive 1024 bytes", 1024, recv},
 		{"Receive 8 kbytes", 8 * 1024 - 2, recv},
+		{"Ping-pong 16 bytes", 16, pingpong},
+		{"Ping-pong 1024 bytes", 1024, pingpong},
+		{"Echo 16 bytes", 16, echo},
+		{"Echo 1024 bytes", 1024, echo},
+		{"Framed send, 1024 byte payloads", 1024, framed_send},
+		{"Framed receive, 1024 byte payloads", 1024, framed_recv},
+#ifdef BACKEND_TESTS
+		BACKEND_TESTS
+#endif
+		/* Full-duplex tests last, they are hidden if the device can't do them. */
+		{"Transceive 1024 bytes", 1024, NULL, 1024},
+		{"Transceive 16 bytes out, 1024 bytes in", 16, NULL, 1024},
+		{"Transceive 1024 bytes out, 16 bytes in", 1024, NULL, 16},
 	};
+	const test_option_t *test;
+	const char *pos;
+	char key;
+
+	BUILD_ASSERT(ARRAY_SIZE(test_menu) <= sizeof(test_keys) - 1);
 
 	lp_printf("\nSelect test:\n");
 	for (int i = 0; i < ARRAY_SIZE(test_menu); i++) {
-		lp_printf("  %c. %s\n", '1' + i, test_menu[i].label);
+		if (test_menu[i].rx_size && !transceive_supported()) {
+			continue;
+		}
+		lp_printf("  %c. %s\n", test_keys[i], test_menu[i].label);
 	}
 	lp_printf("  Esc. Disable device\n");
 
-	input = lp_get();
+	key = lp_get();
 
-	if (input == '\e') {
+	if (key == '\e') {
 		lp_printf("Disable device\n");
 		return false;
 	}
 
-	input -= '1';
+	pos = key ? strchr(test_keys, key) : NULL;
+	input = pos ? pos - test_keys : -1;
 
-	if (input < 0 || input >= ARRAY_SIZE(test_menu)) {
+	if (input < 0 || input >= ARRAY_SIZE(test_menu) ||
+	    (test_menu[input].rx_size && !transceive_supported())) {
 		/* Invalid selection. */
-		lp_printf("Invalid selection '%c'\n", input + '1');
+		lp_printf("Invalid selection '%c'\n", key);
 		return true;
 	}
 
-	lp_printf("Selected test '%s'\n", test_menu[input].label);
+	test = &test_menu[input];
+
+	lp_printf("Selected test '%s'\n", test->label);
 
 	sleep(1);
 
-	ret = test_menu[input].func(test_menu[input].size);
+	/* Messages of the driver are printed after the test. */
+	lp_log_begin();
+	xfer_timing_begin();
+	if (test->rx_size) {
+		ret = set_size_and_transceive(test->size, test->rx_size);
+	} else {
+		ret = test->func(test->size);
+	}
+	xfer_timing_end(&timing);
 
 	sleep(1);
+	lp_log_flush();
 
 	if (ret == 0) {
 		lp_printf("Test done\n", ret);
 	} else if (ret < 0) {
 		lp_printf(RED "Test returned %d\n" NORMAL, ret);
+	} else if (test->rx_size) {
+		lp_printf("Sent %d bytes, ", test->size);
+		lp_print_rx(ret, test->rx_size);
+		print_timing(ret + test->size, &timing);
 	} else {
-		if (test_menu[input].label[0] == 'R') {
-			lp_print_rx(ret, test_menu[input].size);
-		} else if (test_menu[input].size != ret) {
+		if (test->label[0] == 'R') {
+			lp_print_rx(ret, test->size);
+		} else if (test->size != ret) {
 			lp_printf("Send %d bytes " RED "instead of %d bytes" NORMAL "\n", ret,
-				  test_menu[input].size);
+				  test->size);
 		} else {
 			lp_printf("Send %d bytes " GREEN "OK" NORMAL "\n", ret);
 		}
+		print_timing(ret, &timing);
+	}
+
+	return true;
+}
+
+#ifdef RAW_TEST
+
+#define SWEEP_MAX_SIZES 16
+/* Like the 8 kbyte menu tests, 8192 doesn't fit the 13 bit EasyDMA MAXCNT. */
+#define SWEEP_MAX_SIZE  (sizeof(tx_buffer) - 2)
+#define SWEEP_MAX_REPETITIONS 1000
+
+static int sweep_parse_sizes(int *sizes)
+{
+	const char *p = CONFIG_SWEEP_SIZES;
+	int count = 0;
+	char *end;
+
+	while (count < SWEEP_MAX_SIZES) {
+		long size = strtol(p, &end, 0);
+
+		if (end == p) {
+			break;
+		}
+		sizes[count++] = CLAMP(size, 2, SWEEP_MAX_SIZE);
+		p = end;
+	}
+
+	return count;
+}
+
+enum sweep_direction {
+	SWEEP_TX,
+	SWEEP_RX,
+	SWEEP_TRX,
+};
+
+static const char *const sweep_direction_names[] = {"tx", "rx", "trx"};
+
+#define SWEEP_CSV_HEADER "key,device,direction,size,transfers,errors,wire_Bps,effective_Bps," \
+			 "latency_min_us,latency_p50_us,latency_p90_us,latency_p99_us,latency_max_us\n"
+
+static int sweep_transfer(enum sweep_direction direction, int size)
+{
+	switch (direction) {
+	case SWEEP_TX:
+		return set_size_and_send(size);
+	case SWEEP_RX:
+		return recv(size);
+	default:
+		return set_size_and_transceive(size, size);
+	}
+}
+
+/* Run all repetitions of one device, direction and size and print them as a CSV row.
+ * Returns false if the first transfer timed out, the peer is most likely missing.
+ */
+static bool sweep_run(char key, const char *label, enum sweep_direction direction, int size,
+		      int repetitions, int gap_ms)
+{
+	static uint32_t latency[SWEEP_MAX_REPETITIONS];
+	const char *name = sweep_direction_names[direction];
+	struct xfer_timing timing;
+	struct stats stats;
+	uint64_t bytes = 0;
+	uint64_t wire_us = 0;
+	uint64_t total_us = 0;
+	int errors = 0;
+	int count;
+
+	for (count = 0; count < repetitions; count++) {
+		int ret;
+
+		k_msleep(gap_ms);
+
+		xfer_timing_begin();
+		ret = sweep_transfer(direction, size);
+		xfer_timing_end(&timing);
+
+		if (ret == -ETIMEDOUT && count == 0) {
+			lp_printf("%c,\"%s\",%s,%d,0,%d,,,,,,,\n", key, label, name, size,
+				  repetitions);
+			return false;
+		}
+
+		latency[count] = timing.total_us;
+
+		if (ret != size || (direction != SWEEP_TX &&
+				    ((rx_buffer[0] << 8) + rx_buffer[1] != size ||
+				     rx_first_error(ret) >= 0))) {
+			errors++;
+		}
+		if (ret > 0) {
+			/* Full-duplex moves the bytes in both directions at the same time. */
+			bytes += direction == SWEEP_TRX ? 2 * ret : ret;
+			wire_us += timing.wire_us;
+			total_us += timing.total_us;
+		}
 	}
 
+	stats_calc(latency, count, &stats);
+
+	lp_printf("%c,\"%s\",%s,%d,%d,%d,%llu,%llu,%u,%u,%u,%u,%u\n", key, label, name, size,
+		  count, errors,
+		  wire_us ? bytes * 1000000 / wire_us : 0,
+		  total_us ? bytes * 1000000 / total_us : 0,
+		  stats.min, stats.p50, stats.p90, stats.p99, stats.max);
+
 	return true;
 }
 
+/* Next direction in the CONFIG_SWEEP_DIRECTIONS list, false at the end of the list. */
+static bool sweep_next_direction(const char **list, enum sweep_direction *direction)
+{
+	while (**list) {
+		const char *word = *list + strspn(*list, " ");
+		int len = strcspn(word, " ");
+
+		*list = word + len;
+
+		for (int i = 0; i < ARRAY_SIZE(sweep_direction_names); i++) {
+			if (len == strlen(sweep_direction_names[i]) &&
+			    strncmp(word, sweep_direction_names[i], len) == 0) {
+				*direction = i;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/* Run every sweepable device over all sizes and directions without interaction. */
+static void sweep(void)
+{
+	int sizes[SWEEP_MAX_SIZES];
+	int size_count = sweep_parse_sizes(sizes);
+
+	lp_printf(SWEEP_CSV_HEADER);
+
+	for (int index = 0; index < ARRAY_SIZE(device_menu); index++) {
+		const device_option_t *device = &device_menu[index];
+		const char *directions = CONFIG_SWEEP_DIRECTIONS;
+		enum sweep_direction direction;
+
+		if (device->no_sweep) {
+			continue;
+		}
+
+		device->init(device->bitrate);
+		send = device->send;
+		recv = device->recv;
+		transceive = device->transceive;
+
+		while (sweep_next_direction(&directions, &direction)) {
+			if (direction == SWEEP_TRX && !transceive) {
+				continue;
+			}
+
+			for (int i = 0; i < size_count; i++) {
+				if (!sweep_run(device_keys[index], device->label, direction, sizes[i],
+					       CONFIG_SWEEP_REPETITIONS, CONFIG_SWEEP_GAP_MS)) {
+					/* Don't wait for a missing peer at every size. */
+					break;
+				}
+			}
+		}
+
+		device->deinit();
+		send = no_send;
+		recv = no_recv;
+		deinit = no_deinit;
+		transceive = NULL;
+	}
+
+	lp_printf("Sweep done\n");
+}
+
+static const uint32_t spim_frequencies[][2] = {
+	{125000, SPIM_FREQUENCY_FREQUENCY_K125},
+	{250000, SPIM_FREQUENCY_FREQUENCY_K250},
+	{500000, SPIM_FREQUENCY_FREQUENCY_K500},
+	{1000000, SPIM_FREQUENCY_FREQUENCY_M1},
+	{2000000, SPIM_FREQUENCY_FREQUENCY_M2},
+	{4000000, SPIM_FREQUENCY_FREQUENCY_M4},
+	{8000000, SPIM_FREQUENCY_FREQUENCY_M8},
+};
+
+static const uint32_t twim_frequencies[][2] = {
+	{100000, TWIM_FREQUENCY_FREQUENCY_K100},
+	{250000, TWIM_FREQUENCY_FREQUENCY_K250},
+	{400000, TWIM_FREQUENCY_FREQUENCY_K400},
+};
+
+/* Fastest listed frequency not above 'bps', the slowest if all are above. */
+static uint32_t command_frequency(const uint32_t (*frequencies)[2], int count, uint32_t *bps)
+{
+	int i = 0;
+
+	while (i + 1 < count && frequencies[i + 1][0] <= *bps) {
+		i++;
+	}
+	*bps = frequencies[i][0];
+
+	return frequencies[i][1];
+}
+
+/* Register value of 'bps' for the device, 0 if its bitrate can't be set. The bitrate that
+ * will be used is written back to 'bps'.
+ */
+static uint32_t command_bitrate(const device_option_t *device, uint32_t *bps)
+{
+	if (device->init == uart_init || device->init == uart_timeout_init ||
+	    device->init == uart_timeout_chars_init ||
+	    device->init == uart_lp_init || device->init == uart_session_init ||
+	    device->init == loop_uart_init) {
+		uint32_t reg = UART_BAUDRATE(*bps);
+
+		*bps = ((uint64_t)reg * 16000000) >> 32;
+		return reg;
+	}
+	if (device->init == spim_init || device->init == spim_hw_cs_init ||
+	    device->init == loop_spi_init) {
+		return command_frequency(spim_frequencies, ARRAY_SIZE(spim_frequencies), bps);
+	}
+#if DT_NODE_EXISTS(DT_NODELABEL(spi_master_ab))
+	if (device->init == spim_dt_init) {
+		return command_frequency(spim_frequencies, ARRAY_SIZE(spim_frequencies), bps);
+	}
+#endif
+	if (device->init == twim_init || device->init == loop_twi_init) {
+		return command_frequency(twim_frequencies, ARRAY_SIZE(twim_frequencies), bps);
+	}
+
+	return 0;
+}
+
+/* Run one line of "<device> <bps> <size> <tx|rx|trx> [repetitions] [gap ms]". A bitrate of 0
+ * keeps the bitrate of the menu entry.
+ */
+static void command(void)
+{
+	char line[64];
+	char direction_name[4];
+	const device_option_t *device;
+	enum sweep_direction direction;
+	const char *pos;
+	uint32_t bitrate;
+	uint32_t bps;
+	int repetitions = CONFIG_SWEEP_REPETITIONS;
+	int gap_ms = CONFIG_SWEEP_GAP_MS;
+	int size;
+	char key;
+	int i;
+
+	lp_printf("<device> <bps> <size> <tx|rx|trx> [repetitions] [gap ms]: ");
+	lp_get_line(line, sizeof(line));
+	lp_printf("%s\n", line);
+
+	if (sscanf(line, " %c %u %d %3s %d %d", &key, &bps, &size, direction_name,
+		   &repetitions, &gap_ms) < 4) {
+		lp_printf("Invalid command\n");
+		return;
+	}
+
+	pos = strchr(device_keys, key);
+	if (!pos || pos - device_keys >= ARRAY_SIZE(device_menu) ||
+	    device_menu[pos - device_keys].no_sweep) {
+		lp_printf("Invalid device '%c'\n", key);
+		return;
+	}
+	device = &device_menu[pos - device_keys];
+
+	for (i = 0; i < ARRAY_SIZE(sweep_direction_names); i++) {
+		if (strcmp(direction_name, sweep_direction_names[i]) == 0) {
+			break;
+		}
+	}
+	if (i == ARRAY_SIZE(sweep_direction_names) || (i == SWEEP_TRX && !device->transceive)) {
+		lp_printf("Invalid direction '%s'\n", direction_name);
+		return;
+	}
+	direction = i;
+
+	size = CLAMP(size, 2, SWEEP_MAX_SIZE);
+	repetitions = CLAMP(repetitions, 1, SWEEP_MAX_REPETITIONS);
+	gap_ms = MAX(gap_ms, 0);
+
+	bitrate = bps ? command_bitrate(device, &bps) : device->bitrate;
+	if (!bitrate) {
+		lp_printf("The bitrate of '%s' can't be set\n", device->label);
+		bitrate = device->bitrate;
+	} else if (bps) {
+		lp_printf("Using %u bps\n", bps);
+	}
+
+	device->init(bitrate);
+	send = device->send;
+	recv = device->recv;
+	transceive = device->transceive;
+
+	lp_printf(SWEEP_CSV_HEADER);
+	sweep_run(key, device->label, direction, size, repetitions, gap_ms);
+
+	device->deinit();
+	send = no_send;
+	recv = no_recv;
+	deinit = no_deinit;
+	transceive = NULL;
+}
+
+#endif
 
 int main(void)
 {
@@ -364,11 +1095,18 @@ int main(void)
 	NRF_UARTE0_NS->INTEN = 0;
 	NRF_UARTE0_NS->ENABLE = 0;
 
+	/* Zephyr drivers of the DT tests own the GPIOTE1 interrupt, wake up through the driver. */
+#ifdef RAW_TEST
+	lp_input_init(false);
+#else
+	lp_input_init(true);
+#endif
+
+	xfer_timing_init();
+
 	lp_printf("Sample has started\n");
 
-	for (int i = 0; i < sizeof(tx_buffer); i++) {
-		tx_buffer[i] = i;
-	}
+	tx_pattern_restore();
 
 	while (1) {
 #ifdef RAW_TEST
@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+/* Concurrent buses: SPIM1, SPIM3 and UARTE2 move data at the same time, each from its own
+ * buffers. Every bus first runs alone and then all together, the difference shows how much
+ * the buses slow each other down on the shared EasyDMA bus and in the interrupt handling.
+ * Only transmit and SPI receive are used so no peer is needed.
+ */
+
+#include <stdio.h>
+#include <unistd.h>
+#include <zephyr/kernel.h>
+
+#include "bus.h"
+
+/* Each run lasts this long. */
+#define MULTIBUS_MS 1000
+
+#define BUS_COUNT 3
+
+int lp_printf(const char *fmt, ...);
+
+static uint8_t spim3_tx[4 * 1024];
+static uint8_t spim3_rx[4 * 1024];
+static uint8_t uarte2_tx[4 * 1024];
+static uint8_t uarte2_rx[4 * 1024];
+
+static struct spim_instance spim3 = {
+	.regs = NRF_SPIM3_NS,
+	.irq = SPIM3_SPIS3_TWIM3_TWIS3_UARTE3_IRQn,
+	.pin_sck = 10,
+	.pin_mosi = 11,
+	.pin_miso = 12,
+	.pin_cs = 13,
+	.tx_buffer = spim3_tx,
+	.rx_buffer = spim3_rx,
+};
+
+static struct uarte_instance uarte2 = {
+	.regs = NRF_UARTE2_NS,
+	.irq = SPIM2_SPIS2_TWIM2_TWIS2_UARTE2_IRQn,
+	.pin_txd = 14,
+	.pin_rxd = 15,
+	.tx_buffer = uarte2_tx,
+	.rx_buffer = uarte2_rx,
+};
+
+static const char *const bus_names[BUS_COUNT] = {"SPIM1", "SPIM3", "UARTE2"};
+
+/* Start the buses selected in 'mask', let them run and return the bytes moved by each. */
+static void multibus_run(int mask, int size, bool tx, uint64_t *bytes)
+{
+	int max_spim = MIN(size, (int)sizeof(spim3_tx));
+	int max_uart = MIN(size, (int)sizeof(uarte2_tx));
+
+	if (mask & (1 << 0)) {
+		spim_repeat_start(&spim1, max_spim, tx);
+	}
+	if (mask & (1 << 1)) {
+		spim_repeat_start(&spim3, max_spim, tx);
+	}
+	if (mask & (1 << 2)) {
+		uart_repeat_start(&uarte2, max_uart);
+	}
+
+	k_msleep(MULTIBUS_MS);
+
+	if (mask & (1 << 0)) {
+		bytes[0] = spim_repeat_stop(&spim1);
+	}
+	if (mask & (1 << 1)) {
+		bytes[1] = spim_repeat_stop(&spim3);
+	}
+	if (mask & (1 << 2)) {
+		bytes[2] = uart_repeat_stop(&uarte2);
+	}
+}
+
+static int multibus_test(int size, bool tx)
+{
+	uint64_t alone[BUS_COUNT] = {0};
+	uint64_t together[BUS_COUNT] = {0};
+	uint64_t alone_total = 0;
+	uint64_t together_total = 0;
+
+	for (int i = 0; i < BUS_COUNT; i++) {
+		multibus_run(1 << i, size, tx, alone);
+	}
+	multibus_run((1 << BUS_COUNT) - 1, size, tx, together);
+
+	lp_printf("Bus     Alone bytes/s  Together bytes/s\n");
+	for (int i = 0; i < BUS_COUNT; i++) {
+		lp_printf("%-6s  %13llu  %16llu  %3llu%%\n", bus_names[i],
+			  alone[i] * 1000 / MULTIBUS_MS, together[i] * 1000 / MULTIBUS_MS,
+			  alone[i] ? together[i] * 100 / alone[i] : 0);
+		alone_total += alone[i];
+		together_total += together[i];
+	}
+	lp_printf("Total   %13llu  %16llu  %3llu%%\n",
+		  alone_total * 1000 / MULTIBUS_MS, together_total * 1000 / MULTIBUS_MS,
+		  alone_total ? together_total * 100 / alone_total : 0);
+
+	return 0;
+}
+
+void multibus_init(uint32_t bitrate)
+{
+	lp_printf("  SPIM1 @ 8 Mbps\n");
+	spim_instance_init(&spim1, SPIM_FREQUENCY_FREQUENCY_M8);
+	lp_printf("  SPIM3 @ 8 Mbps\n");
+	spim_instance_init(&spim3, SPIM_FREQUENCY_FREQUENCY_M8);
+	lp_printf("  UARTE2 @ 1 Mbps\n");
+	uart_instance_init(&uarte2, bitrate);
+
+	/* Every bus sends its own counting pattern. */
+	for (int i = 0; i < sizeof(spim3_tx); i++) {
+		spim3_tx[i] = i;
+		uarte2_tx[i] = i;
+	}
+}
+
+int multibus_send(int size)
+{
+	return multibus_test(size, true);
+}
+
+/* The SPI masters clock in MISO, the UART keeps sending. */
+int multibus_recv(int size)
+{
+	return multibus_test(size, false);
+}
+
+void multibus_deinit(void)
+{
+	spim_instance_deinit(&spim1);
+	spim_instance_deinit(&spim3);
+	uart_instance_deinit(&uarte2);
+}
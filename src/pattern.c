@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#include "pattern.h"
+
+const char *const pattern_names[PATTERN_COUNT] = {
+	"incrementing", "PRBS-7", "PRBS-15", "PRBS-31", "all zeros", "all ones", "random",
+};
+
+/* Fibonacci LFSR for x^n + x^m + 1, 'state' holds the last n bits with the newest in bit 0.
+ * The next m bits only depend on bits already in the state, so they are made in one step.
+ * The oldest bit ends up in the most significant bit of the first byte, so the sequence is
+ * sent in order by an MSB first bus.
+ */
+static uint32_t prbs_next(uint32_t *state, int n, int m)
+{
+	uint32_t mask = (1u << n) - 1;
+	uint32_t out = 0;
+	int bits = 32;
+
+	while (bits) {
+		int k = bits < m ? bits : m;
+		uint32_t v = ((*state >> (n - k)) ^ (*state >> (m - k))) & ((1u << k) - 1);
+
+		*state = ((*state << k) | v) & mask;
+		out = (out << k) | v;
+		bits -= k;
+	}
+
+	return __builtin_bswap32(out);
+}
+
+static uint32_t pattern_next_word(struct pattern *pattern)
+{
+	uint32_t x = pattern->state;
+
+	switch (pattern->type) {
+	case PATTERN_INCREMENT:
+		pattern->state += 4;
+		return ((x & 0xff) | ((x + 1) & 0xff) << 8 | ((x + 2) & 0xff) << 16 |
+			((x + 3) & 0xff) << 24);
+	case PATTERN_PRBS7:
+		return prbs_next(&pattern->state, 7, 6);
+	case PATTERN_PRBS15:
+		return prbs_next(&pattern->state, 15, 14);
+	case PATTERN_PRBS31:
+		return prbs_next(&pattern->state, 31, 28);
+	case PATTERN_ONES:
+		return 0xffffffff;
+	case PATTERN_RANDOM:
+		/* xorshift32 */
+		x ^= x << 13;
+		x ^= x >> 17;
+		x ^= x << 5;
+		pattern->state = x;
+		return x;
+	default:
+		return 0;
+	}
+}
+
+void pattern_init(struct pattern *pattern, enum pattern_type type)
+{
+	pattern->type = type;
+	pattern->left = 0;
+
+	switch (type) {
+	case PATTERN_INCREMENT:
+		pattern->state = 0;
+		break;
+	case PATTERN_RANDOM:
+		pattern->state = 0x12345678;
+		break;
+	default:
+		/* Any non-zero LFSR state. */
+		pattern->state = 0x7fffffff;
+		break;
+	}
+}
+
+static uint8_t pattern_next_byte(struct pattern *pattern)
+{
+	uint8_t byte;
+
+	if (!pattern->left) {
+		pattern->word = pattern_next_word(pattern);
+		pattern->left = 4;
+	}
+
+	byte = pattern->word & 0xff;
+	pattern->word >>= 8;
+	pattern->left--;
+
+	return byte;
+}
+
+void pattern_fill(struct pattern *pattern, uint8_t *buffer, int size)
+{
+	/* Leftover bytes and alignment, then whole words. */
+	while (size && (pattern->left || ((uintptr_t)buffer & 3))) {
+		*buffer++ = pattern_next_byte(pattern);
+		size--;
+	}
+
+	for (; size >= 4; size -= 4, buffer += 4) {
+		*(uint32_t *)buffer = pattern_next_word(pattern);
+	}
+
+	while (size--) {
+		*buffer++ = pattern_next_byte(pattern);
+	}
+}
+
+void pattern_skip(struct pattern *pattern, int size)
+{
+	while (size--) {
+		pattern_next_byte(pattern);
+	}
+}
+
+uint32_t pattern_check(struct pattern *pattern, const uint8_t *buffer, int size)
+{
+	uint32_t errors = 0;
+
+	while (size && (pattern->left || ((uintptr_t)buffer & 3))) {
+		errors += __builtin_popcount(*buffer++ ^ pattern_next_byte(pattern));
+		size--;
+	}
+
+	for (; size >= 4; size -= 4, buffer += 4) {
+		errors += __builtin_popcount(*(const uint32_t *)buffer ^
+					     pattern_next_word(pattern));
+	}
+
+	while (size--) {
+		errors += __builtin_popcount(*buffer++ ^ pattern_next_byte(pattern));
+	}
+
+	return errors;
+}
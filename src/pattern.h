@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef PATTERN_H_
+#define PATTERN_H_
+
+#include <stdint.h>
+
+/* Test data streams. Sender and receiver start the same pattern and stay in step as long as
+ * both handle the same number of bytes, in chunks of any size.
+ */
+
+enum pattern_type {
+	PATTERN_INCREMENT,
+	PATTERN_PRBS7,
+	PATTERN_PRBS15,
+	PATTERN_PRBS31,
+	PATTERN_ZEROS,
+	PATTERN_ONES,
+	PATTERN_RANDOM,
+	PATTERN_COUNT,
+};
+
+struct pattern {
+	enum pattern_type type;
+	uint32_t state;		/* LFSR, random or byte counter state. */
+	uint32_t word;		/* Generated bytes not used yet, lowest byte first. */
+	int left;		/* Number of bytes left in 'word'. */
+};
+
+extern const char *const pattern_names[PATTERN_COUNT];
+
+void pattern_init(struct pattern *pattern, enum pattern_type type);
+
+/* Write the next 'size' bytes of the pattern. */
+void pattern_fill(struct pattern *pattern, uint8_t *buffer, int size);
+
+/* Move past the next 'size' bytes of the pattern. */
+void pattern_skip(struct pattern *pattern, int size);
+
+/* Compare 'buffer' with the next 'size' bytes of the pattern, returns the number of bit
+ * errors. Aligned data is compared a word at a time.
+ */
+uint32_t pattern_check(struct pattern *pattern, const uint8_t *buffer, int size);
+
+#endif /* PATTERN_H_ */
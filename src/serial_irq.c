@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/sw_isr_table.h>
+
+#include "serial_irq.h"
+
+#define SERIAL_IRQ_PRIO 0
+
+/* A Zephyr driver enabled in the devicetree already owns the vector of its instance, those
+ * instances stay dynamic.
+ */
+#define SERIAL_DT_FREE(n) (!DT_NODE_HAS_STATUS(DT_NODELABEL(spi##n), okay) &&		\
+			   !DT_NODE_HAS_STATUS(DT_NODELABEL(uart##n), okay) &&		\
+			   !DT_NODE_HAS_STATUS(DT_NODELABEL(i2c##n), okay))
+
+/* Vectors of Zephyr drivers replaced by a dynamic connection, for serial_irq_release(). */
+static struct {
+	IRQn_Type irq;
+	struct _isr_table_entry entry;
+	uint32_t priority;
+} serial_saved[4];
+static int serial_saved_count;
+
+static void serial_irq_dynamic(IRQn_Type irq, void (*isr)(const void *arg), const void *arg)
+{
+	int i;
+
+	for (i = 0; i < serial_saved_count; i++) {
+		if (serial_saved[i].irq == irq) {
+			break;
+		}
+	}
+
+	/* Only the first connection sees the handler of the driver. */
+	if (i == serial_saved_count && i < ARRAY_SIZE(serial_saved)) {
+		serial_saved[i].irq = irq;
+		serial_saved[i].entry = _sw_isr_table[irq - CONFIG_GEN_IRQ_START_VECTOR];
+		serial_saved[i].priority = NVIC_GetPriority(irq);
+		serial_saved_count++;
+	}
+
+	irq_connect_dynamic(irq, SERIAL_IRQ_PRIO, isr, arg, 0);
+}
+
+void serial_irq_release(IRQn_Type irq)
+{
+	for (int i = 0; i < serial_saved_count; i++) {
+		if (serial_saved[i].irq == irq) {
+			irq_disable(irq);
+			_sw_isr_table[irq - CONFIG_GEN_IRQ_START_VECTOR] = serial_saved[i].entry;
+			NVIC_SetPriority(irq, serial_saved[i].priority);
+			return;
+		}
+	}
+}
+
+#if defined(CONFIG_SERIAL_IRQ_STATIC)
+
+static void serial_irq_none(const void *arg)
+{
+}
+
+static struct {
+	void (*isr)(const void *arg);
+	const void *arg;
+} serial_handlers[3] = {
+	{serial_irq_none, NULL},
+	{serial_irq_none, NULL},
+	{serial_irq_none, NULL},
+};
+
+/* One load and one call per interrupt, no lookup through the software ISR table. */
+#if SERIAL_DT_FREE(1)
+ISR_DIRECT_DECLARE(serial1_isr)
+{
+	serial_handlers[0].isr(serial_handlers[0].arg);
+	ISR_DIRECT_PM();
+	return 1;
+}
+#endif
+
+#if SERIAL_DT_FREE(2)
+ISR_DIRECT_DECLARE(serial2_isr)
+{
+	serial_handlers[1].isr(serial_handlers[1].arg);
+	ISR_DIRECT_PM();
+	return 1;
+}
+#endif
+
+#if SERIAL_DT_FREE(3)
+ISR_DIRECT_DECLARE(serial3_isr)
+{
+	serial_handlers[2].isr(serial_handlers[2].arg);
+	ISR_DIRECT_PM();
+	return 1;
+}
+#endif
+
+static int serial_irq_setup(void)
+{
+#if SERIAL_DT_FREE(1)
+	IRQ_DIRECT_CONNECT(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, SERIAL_IRQ_PRIO, serial1_isr, 0);
+#endif
+#if SERIAL_DT_FREE(2)
+	IRQ_DIRECT_CONNECT(SPIM2_SPIS2_TWIM2_TWIS2_UARTE2_IRQn, SERIAL_IRQ_PRIO, serial2_isr, 0);
+#endif
+#if SERIAL_DT_FREE(3)
+	IRQ_DIRECT_CONNECT(SPIM3_SPIS3_TWIM3_TWIS3_UARTE3_IRQn, SERIAL_IRQ_PRIO, serial3_isr, 0);
+#endif
+
+	return 0;
+}
+
+SYS_INIT(serial_irq_setup, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+void serial_irq_connect(IRQn_Type irq, void (*isr)(const void *arg), const void *arg)
+{
+	int index;
+
+	switch (irq) {
+#if SERIAL_DT_FREE(1)
+	case SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn:
+		index = 0;
+		break;
+#endif
+#if SERIAL_DT_FREE(2)
+	case SPIM2_SPIS2_TWIM2_TWIS2_UARTE2_IRQn:
+		index = 1;
+		break;
+#endif
+#if SERIAL_DT_FREE(3)
+	case SPIM3_SPIS3_TWIM3_TWIS3_UARTE3_IRQn:
+		index = 2;
+		break;
+#endif
+	default:
+		serial_irq_dynamic(irq, isr, arg);
+		return;
+	}
+
+	/* Don't let the interrupt see a handler with the argument of the previous one. */
+	irq_disable(irq);
+	serial_handlers[index].isr = isr;
+	serial_handlers[index].arg = arg;
+}
+
+#else
+
+void serial_irq_connect(IRQn_Type irq, void (*isr)(const void *arg), const void *arg)
+{
+	serial_irq_dynamic(irq, isr, arg);
+}
+
+#endif /* CONFIG_SERIAL_IRQ_STATIC */
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef SERIAL_IRQ_H_
+#define SERIAL_IRQ_H_
+
+#include <zephyr/kernel.h>
+
+/* Set the handler of a serial box interrupt (SPIM, SPIS, TWIM, TWIS and UARTE instance 1 to 3).
+ * With CONFIG_SERIAL_IRQ_STATIC the vectors are direct ISRs fixed at build time that call the
+ * handler from a table, otherwise the handler is connected as a dynamic interrupt.
+ */
+void serial_irq_connect(IRQn_Type irq, void (*isr)(const void *arg), const void *arg);
+
+/* Give a vector taken over by serial_irq_connect() back to the Zephyr driver of the instance,
+ * with the handler and priority it had before. Nothing happens if it was never taken over.
+ */
+void serial_irq_release(IRQn_Type irq);
+
+#endif /* SERIAL_IRQ_H_ */
@@ -0,0 +1,277 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+/* Zephyr SPI driver on SPIM1 next to the bare driver, in the same image. The spi_master_ab
+ * overlay enables spi1 under a label the DT build chain doesn't pick up, so the menu keeps
+ * all bare tests and adds the Zephyr driver as another device. Both drivers use the same
+ * pins. The Zephyr driver is suspended while the bare driver runs, and gets its interrupt
+ * vector back before it resumes.
+ *
+ * The comparison runs the same transfers through both drivers and reports throughput, the
+ * time per call and the time the CPU was awake. DWT CYCCNT only counts while the CPU clock
+ * runs, so it stops in WFI while the thread waits for the transfer to end.
+ */
+
+#include <stdio.h>
+#include <zephyr/kernel.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+
+#if DT_NODE_EXISTS(DT_NODELABEL(spi_master_ab))
+
+#include <zephyr/drivers/spi.h>
+#include <zephyr/pm/device.h>
+
+#include "serial_irq.h"
+#include "stats.h"
+#include "xfer_timing.h"
+
+#define USED_DEV DT_NODELABEL(spi_master_ab)
+#define DT_DRV_COMPAT nordic_nrf_spim
+#define SPI_MASTER NRF_SPIM1_NS
+#define SPI_MASTER_IRQn SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn
+
+int lp_printf(const char *fmt, ...);
+
+void spim_init(uint32_t bitrate);
+int spim_send(int size);
+int spim_recv(int size);
+void spim_deinit(void);
+
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
+
+static const struct device *p_dev = DEVICE_DT_GET(USED_DEV);
+static struct spi_config spi_cfg = {
+	.operation = SPI_WORD_SET(8) | SPI_TRANSFER_MSB | SPI_MODE_CPOL | SPI_MODE_CPHA,
+	.frequency = 1000000,
+	.slave = 0,
+	.cs.gpio = GPIO_DT_SPEC_INST_GET(0, cs_gpios),
+	/* No CSN to CLK delay, like spim_send() of the bare driver. */
+	.cs.delay = 0,
+};
+
+/* SPIM FREQUENCY register value of the bare driver, selected by the device menu. */
+static uint32_t ab_bitrate;
+
+/* The bare driver owns SPIM1 until the Zephyr driver is selected. */
+static int spim_ab_setup(void)
+{
+	pm_device_action_run(p_dev, PM_DEVICE_ACTION_SUSPEND);
+
+	return 0;
+}
+
+SYS_INIT(spim_ab_setup, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+/* 'bitrate' is a SPIM FREQUENCY register value like for the bare driver, K125 to M8 are
+ * multiples of 125 kHz in bits 25 and up.
+ */
+void spim_dt_init(uint32_t bitrate)
+{
+	spi_cfg.frequency = (bitrate >> 25) * 125000;
+
+	lp_printf("\nUsing SPI Master device: %s @ %u Hz\n", p_dev->name, spi_cfg.frequency);
+
+	serial_irq_release(SPI_MASTER_IRQn);
+	pm_device_action_run(p_dev, PM_DEVICE_ACTION_RESUME);
+
+	lp_printf("    SCK     P0.%02d\n", SPI_MASTER->PSEL.SCK);
+	lp_printf("    MOSI    P0.%02d\n", SPI_MASTER->PSEL.MOSI);
+	lp_printf("    MISO    P0.%02d\n", SPI_MASTER->PSEL.MISO);
+	lp_printf("    CS      P0.%02d\n", spi_cfg.cs.gpio.pin);
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	SPI_MASTER->PUBLISH_STARTED = SPIM_PUBLISH_STARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	SPI_MASTER->PUBLISH_END = SPIM_PUBLISH_END_EN_Msk | XFER_TIMING_DPPI_END;
+}
+
+int spim_dt_send(int size)
+{
+	const struct spi_buf tx_buf = {
+		.buf = tx_buffer,
+		.len = size
+	};
+	const struct spi_buf_set tx = {
+		.buffers = &tx_buf,
+		.count = 1
+	};
+	int err;
+
+	err = spi_write(p_dev, &spi_cfg, &tx);
+
+	return err == 0 ? size : err;
+}
+
+int spim_dt_recv(int size)
+{
+	struct spi_buf rx_buf = {
+		.buf = rx_buffer,
+		.len = size,
+	};
+	const struct spi_buf_set rx = {
+		.buffers = &rx_buf,
+		.count = 1
+	};
+	int err;
+
+	err = spi_read(p_dev, &spi_cfg, &rx);
+
+	return err == 0 ? size : err;
+}
+
+int spim_dt_transceive(int tx_size, int rx_size)
+{
+	const struct spi_buf tx_buf = {
+		.buf = tx_buffer,
+		.len = tx_size
+	};
+	const struct spi_buf_set tx = {
+		.buffers = &tx_buf,
+		.count = 1
+	};
+	struct spi_buf rx_buf = {
+		.buf = rx_buffer,
+		.len = rx_size,
+	};
+	const struct spi_buf_set rx = {
+		.buffers = &rx_buf,
+		.count = 1
+	};
+	int err;
+
+	err = spi_transceive(p_dev, &spi_cfg, &tx, &rx);
+
+	return err == 0 ? rx_size : err;
+}
+
+void spim_dt_deinit(void)
+{
+	SPI_MASTER->PUBLISH_STARTED = 0;
+	SPI_MASTER->PUBLISH_END = 0;
+	spi_release(p_dev, &spi_cfg);
+	/* Hands SPIM1 and the pins back for the bare driver. */
+	pm_device_action_run(p_dev, PM_DEVICE_ACTION_SUSPEND);
+}
+
+struct ab_result {
+	uint64_t bytes;
+	uint32_t total_us;
+	uint32_t cpu_us;
+	struct stats call_us;
+};
+
+struct ab_backend {
+	const char *label;
+	void (*init)(uint32_t bitrate);
+	int (*send)(int size);
+	int (*recv)(int size);
+	void (*deinit)(void);
+};
+
+static const struct ab_backend ab_backends[] = {
+	{"Bare", spim_init, spim_send, spim_recv, spim_deinit},
+	{"Zephyr", spim_dt_init, spim_dt_send, spim_dt_recv, spim_dt_deinit},
+};
+
+static int ab_run(const struct ab_backend *backend, int size, bool tx, struct ab_result *result)
+{
+	static uint32_t call_us[CONFIG_AB_TRANSFERS];
+	uint64_t cycles = 0;
+	uint32_t total = 0;
+	int err = 0;
+
+	result->bytes = 0;
+
+	backend->init(ab_bitrate);
+
+	for (int i = 0; i < CONFIG_AB_TRANSFERS; i++) {
+		uint32_t start = k_cycle_get_32();
+		uint32_t cpu_start = xfer_timing_cycles();
+		int ret;
+
+		ret = tx ? backend->send(size) : backend->recv(size);
+
+		cycles += xfer_timing_cycles() - cpu_start;
+		call_us[i] = k_cyc_to_us_floor32(k_cycle_get_32() - start);
+		total += call_us[i];
+
+		if (ret != size) {
+			err = ret < 0 ? ret : -EIO;
+			break;
+		}
+		result->bytes += ret;
+	}
+
+	backend->deinit();
+
+	if (err) {
+		return err;
+	}
+
+	result->total_us = total;
+	result->cpu_us = xfer_timing_cycles_to_us(cycles);
+	stats_calc(call_us, CONFIG_AB_TRANSFERS, &result->call_us);
+
+	return 0;
+}
+
+static int spim_ab_compare(int size, bool tx)
+{
+	struct ab_result results[ARRAY_SIZE(ab_backends)];
+	bool cpu_time = xfer_timing_cycles_init();
+
+	for (int i = 0; i < ARRAY_SIZE(ab_backends); i++) {
+		int err = ab_run(&ab_backends[i], size, tx, &results[i]);
+
+		if (err) {
+			lp_printf("%s driver failed %d\n", ab_backends[i].label, err);
+			return err;
+		}
+	}
+
+	lp_printf("%d %s transfers of %d bytes, times in us\n", CONFIG_AB_TRANSFERS,
+		  tx ? "send" : "receive", size);
+	lp_printf("Driver    Bytes/s  Call min   p50   p99   max  CPU us  CPU %%\n");
+	for (int i = 0; i < ARRAY_SIZE(ab_backends); i++) {
+		struct ab_result *result = &results[i];
+
+		lp_printf("%-6s  %9llu  %8u %5u %5u %5u  ", ab_backends[i].label,
+			  result->bytes * 1000000 / MAX(result->total_us, 1), result->call_us.min,
+			  result->call_us.p50, result->call_us.p99, result->call_us.max);
+		if (cpu_time) {
+			lp_printf("%6u  %4u%%\n", result->cpu_us,
+				  result->cpu_us * 100 / MAX(result->total_us, 1));
+		} else {
+			lp_printf("   n/a    n/a\n");
+		}
+	}
+
+	return 0;
+}
+
+/* Each run initialises its own driver, only remember the frequency. */
+void spim_ab_init(uint32_t bitrate)
+{
+	ab_bitrate = bitrate;
+}
+
+int spim_ab_send(int size)
+{
+	return spim_ab_compare(size, true);
+}
+
+int spim_ab_recv(int size)
+{
+	return spim_ab_compare(size, false);
+}
+
+void spim_ab_deinit(void)
+{
+}
+
+#endif /* DT_NODE_EXISTS(DT_NODELABEL(spi_master_ab)) */
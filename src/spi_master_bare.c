@@ -9,89 +9,243 @@
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
-#define SPI_MASTER NRF_SPIM1_NS
+#include "bus.h"
+#include "pattern.h"
+#include "serial_irq.h"
+#include "term_color.h"
+#include "xfer_timing.h"
+
 #define GPIO       NRF_P0_NS
-#define PIN_SCK    6
-#define PIN_MISO   3
-#define PIN_MOSI   2
-#define PIN_CS     7
 
-extern uint8_t tx_buffer[1024];
-extern uint8_t rx_buffer[2048];
+/* The delayed, hardware chip select, burst and streaming tests only run on instance 1. */
+#define SPI_MASTER spim1.regs
+#define PIN_CS     spim1.pin_cs
 
-int lp_printf(const char *fmt, ...);
+/* Hardware chip select: TIMER compares drive CS through GPIOTE and start the SPIM. */
+#define CS_TIMER         NRF_TIMER0_NS
+#define CS_GPIOTE        NRF_GPIOTE1_NS
+#define CS_GPIOTE_NR     2
+#define CS_DPPI_CHANNEL  4
+#define START_DPPI_CHANNEL 5
+
+/* Streaming runs this long at every frequency. */
+#define STREAM_SECONDS   2
+/* Smallest DMA half, the STARTED interrupt must re-arm the pointer before the half is sent. */
+#define STREAM_MIN_CHUNK 256
+/* Frames per burst and the END to START gaps of the back-to-back frame test. */
+#define BURST_FRAMES     1000
+#define BURST_PAUSE_MS   2000
 
-K_SEM_DEFINE(spim_done, 0, 1);
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
+
+int lp_printf(const char *fmt, ...);
+void tx_pattern_restore(void);
+void spim_deinit(void);
+
+struct spim_instance spim1 = {
+	.regs = NRF_SPIM1_NS,
+	.irq = SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn,
+	.pin_sck = 6,
+	.pin_mosi = 2,
+	.pin_miso = 3,
+	.pin_cs = 7,
+	.tx_buffer = tx_buffer,
+	.rx_buffer = rx_buffer,
+};
+
+static uint32_t spim_bitrate;
+
+/* Streaming state, stream_chunks is 0 for single transfers. */
+static volatile uint32_t *stream_ptr;
+static uint8_t *stream_base;
+static int stream_chunk_size;
+static int stream_chunks;
+static volatile int stream_ended;
+/* Check the header and last byte of every received chunk. */
+static bool stream_check;
+static volatile int stream_errors;
+/* Full-duplex streaming also moves the RX pointer, and wakes the thread for every chunk. */
+static volatile uint32_t *stream_rx_ptr;
+static uint8_t *stream_rx_base;
+
+K_SEM_DEFINE(stream_chunk, 0, 1);
+
+static const uint8_t burst_gaps_us[] = {100, 50, 20, 10, 5, 3, 2};
 
 void spim_isr(const void *arg)
 {
-	SPI_MASTER->EVENTS_END = 0;
-	k_sem_give(&spim_done);
+	struct spim_instance *spim = (struct spim_instance *)arg;
+	NRF_SPIM_Type *regs = spim->regs;
+	/* Streaming and bursts only run on instance 1. */
+	bool stream = spim == &spim1 && stream_chunks;
+
+	if (regs->EVENTS_END) {
+		regs->EVENTS_END = 0;
+
+		if (spim->repeat) {
+			spim->bytes += regs->TXD.AMOUNT + regs->RXD.AMOUNT;
+			regs->TASKS_START = 1;
+			return;
+		}
+
+		if (stream && stream_check) {
+			uint8_t *chunk = stream_base + (stream_ended & 1) * stream_chunk_size;
+
+			if ((chunk[0] << 8) + chunk[1] != stream_chunk_size ||
+			    chunk[stream_chunk_size - 1] != ((stream_chunk_size - 1) & 0xff)) {
+				stream_errors++;
+			}
+		}
+
+		if (!stream || ++stream_ended == stream_chunks) {
+			k_sem_give(&spim->done);
+		}
+		if (stream && stream_rx_ptr) {
+			k_sem_give(&stream_chunk);
+		}
+	}
+
+	if (regs->EVENTS_STARTED) {
+		regs->EVENTS_STARTED = 0;
+
+		if (!stream) {
+			return;
+		}
+
+		/* The current half is latched, point to the other half for the next one. */
+		if (stream_ended + 1 < stream_chunks) {
+			int offset = ((stream_ended + 1) & 1) * stream_chunk_size;
+
+			*stream_ptr = (int)stream_base + offset;
+			if (stream_rx_ptr) {
+				*stream_rx_ptr = (int)stream_rx_base + offset;
+			}
+		} else {
+			/* Last chunk is on the wire, don't restart after it. */
+			regs->SHORTS = 0;
+			CS_TIMER->SUBSCRIBE_START = 0;
+		}
+	}
 }
 
-void spim_init(uint32_t bitrate)
+void spim_instance_init(struct spim_instance *spim, uint32_t bitrate)
 {
+	NRF_SPIM_Type *regs = spim->regs;
+
+	k_sem_init(&spim->done, 0, 1);
+	spim->repeat = false;
+
 	/* MISO: Dir input, input connect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_MISO] = 0;
+	GPIO->PIN_CNF[spim->pin_miso] = 0;
 
 	/* Configure pins. */
-	SPI_MASTER->PSEL.SCK = PIN_SCK;
-	SPI_MASTER->PSEL.MOSI = PIN_MOSI;
-	SPI_MASTER->PSEL.MISO = PIN_MISO;
+	regs->PSEL.SCK = spim->pin_sck;
+	regs->PSEL.MOSI = spim->pin_mosi;
+	regs->PSEL.MISO = spim->pin_miso;
 
 	/* Configure buffers. */
-	SPI_MASTER->RXD.PTR = (int)rx_buffer;
-	SPI_MASTER->TXD.PTR = (int)tx_buffer;
+	regs->RXD.PTR = (int)spim->rx_buffer;
+	regs->TXD.PTR = (int)spim->tx_buffer;
 
 	/* Most significant bit first, Sample on trailing edge, Active low.  */
-	SPI_MASTER->CONFIG = SPIS_CONFIG_CPOL_Msk | SPIS_CONFIG_CPHA_Msk;
+	regs->CONFIG = SPIS_CONFIG_CPOL_Msk | SPIS_CONFIG_CPHA_Msk;
 
 	/* Frequency */
-	SPI_MASTER->FREQUENCY = bitrate;
+	regs->FREQUENCY = bitrate;
 
 	/* Enable interrupt to wake up at the end of a message. */
-	SPI_MASTER->INTENSET = SPIM_INTENSET_END_Msk;
-	irq_connect_dynamic(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, 0, spim_isr, NULL, 0);
-	irq_enable(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn);
+	regs->INTENSET = SPIM_INTENSET_END_Msk;
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	regs->PUBLISH_STARTED = SPIM_PUBLISH_STARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	regs->PUBLISH_END = SPIM_PUBLISH_END_EN_Msk | XFER_TIMING_DPPI_END;
+
+	serial_irq_connect(spim->irq, spim_isr, spim);
+	irq_enable(spim->irq);
 
 	/* Enable. */
-	SPI_MASTER->ENABLE = SPIM_ENABLE_ENABLE_Enabled;
+	regs->ENABLE = SPIM_ENABLE_ENABLE_Enabled;
 
 	/* SCK: Dir output, input disconnect, pull disabled, drive h0h1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SCK] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+	GPIO->PIN_CNF[spim->pin_sck] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
 				 (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
 				 (GPIO_PIN_CNF_DRIVE_H0H1 << GPIO_PIN_CNF_DRIVE_Pos);
 	/* MOSI: Dir output, input disconnect, pull disabled, drive h0h1, sense disabled. */
-	GPIO->PIN_CNF[PIN_MOSI] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+	GPIO->PIN_CNF[spim->pin_mosi] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
 				  (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
 				  (GPIO_PIN_CNF_DRIVE_H0H1 << GPIO_PIN_CNF_DRIVE_Pos);
 	/* CS: high. */
-	GPIO->OUTSET = 1 << PIN_CS;
+	GPIO->OUTSET = 1 << spim->pin_cs;
 	/* CS: Dir output, input disconnect, pull disabled, drive h0h1, sense disabled. */
-	GPIO->PIN_CNF[PIN_CS] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+	GPIO->PIN_CNF[spim->pin_cs] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
 				(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
 				(GPIO_PIN_CNF_DRIVE_H0H1 << GPIO_PIN_CNF_DRIVE_Pos);
 
-	lp_printf("    SCK     P0.%02d\n", PIN_SCK);
-	lp_printf("    MOSI    P0.%02d\n", PIN_MOSI);
-	lp_printf("    MISO    P0.%02d\n", PIN_MISO);
-	lp_printf("    CS      P0.%02d\n", PIN_CS);
+	lp_printf("    SCK     P0.%02d\n", spim->pin_sck);
+	lp_printf("    MOSI    P0.%02d\n", spim->pin_mosi);
+	lp_printf("    MISO    P0.%02d\n", spim->pin_miso);
+	lp_printf("    CS      P0.%02d\n", spim->pin_cs);
 }
 
-int spim_send(int size)
+void spim_init(uint32_t bitrate)
 {
-	SPI_MASTER->TXD.MAXCNT = size;
-	SPI_MASTER->RXD.MAXCNT = 0;
+	spim_bitrate = bitrate;
+	spim_instance_init(&spim1, bitrate);
+}
+
+/* Clock max(tx_size, rx_size) bytes, sending and receiving at the same time. Returns the
+ * number of bytes clocked.
+ */
+int spim_instance_transfer(struct spim_instance *spim, int tx_size, int rx_size)
+{
+	spim->regs->TXD.MAXCNT = tx_size;
+	spim->regs->RXD.MAXCNT = rx_size;
 
 	/* CS: low. */
-	GPIO->OUTCLR = 1 << PIN_CS;
+	GPIO->OUTCLR = 1 << spim->pin_cs;
 
-	SPI_MASTER->TASKS_START = 1;
+	spim->regs->TASKS_START = 1;
 
-	k_sem_take(&spim_done, K_FOREVER);
+	k_sem_take(&spim->done, K_FOREVER);
 
 	/* CS: high. */
-	GPIO->OUTSET = 1 << PIN_CS;
+	GPIO->OUTSET = 1 << spim->pin_cs;
+
+	return MAX(spim->regs->TXD.AMOUNT, spim->regs->RXD.AMOUNT);
+}
+
+/* CS stays low while the interrupt restarts the transfer. */
+void spim_repeat_start(struct spim_instance *spim, int size, bool tx)
+{
+	spim->bytes = 0;
+	spim->repeat = true;
+	spim->regs->TXD.MAXCNT = tx ? size : 0;
+	spim->regs->RXD.MAXCNT = tx ? 0 : size;
+
+	/* CS: low. */
+	GPIO->OUTCLR = 1 << spim->pin_cs;
+
+	spim->regs->TASKS_START = 1;
+}
+
+uint64_t spim_repeat_stop(struct spim_instance *spim)
+{
+	/* The transfer on the wire ends normally. */
+	spim->repeat = false;
+	if (!k_sem_take(&spim->done, K_MSEC(100))) {
+		spim->bytes += spim->regs->TXD.AMOUNT + spim->regs->RXD.AMOUNT;
+	}
+
+	/* CS: high. */
+	GPIO->OUTSET = 1 << spim->pin_cs;
+
+	return spim->bytes;
+}
+
+int spim_send(int size)
+{
+	spim_instance_transfer(&spim1, size, 0);
 
 	return SPI_MASTER->TXD.AMOUNT;
 }
@@ -108,7 +262,7 @@ int spim_send_delayed(int size)
 
 	SPI_MASTER->TASKS_START = 1;
 
-	k_sem_take(&spim_done, K_FOREVER);
+	k_sem_take(&spim1.done, K_FOREVER);
 
 	usleep(1);
 
@@ -119,6 +273,25 @@ int spim_send_delayed(int size)
 }
 
 int spim_recv(int size)
+{
+	spim_instance_transfer(&spim1, 0, size);
+
+	return SPI_MASTER->RXD.AMOUNT;
+}
+
+/* Full-duplex, returns the number of bytes received or -EIO if not everything was sent. */
+int spim_transceive(int tx_size, int rx_size)
+{
+	spim_instance_transfer(&spim1, tx_size, rx_size);
+
+	if (SPI_MASTER->TXD.AMOUNT != tx_size) {
+		return -EIO;
+	}
+
+	return SPI_MASTER->RXD.AMOUNT;
+}
+
+int spim_recv_delayed(int size)
 {
 	SPI_MASTER->TXD.MAXCNT = 0;
 	SPI_MASTER->RXD.MAXCNT = size;
@@ -126,9 +299,13 @@ int spim_recv(int size)
 	/* CS: low. */
 	GPIO->OUTCLR = 1 << PIN_CS;
 
+	usleep(80);
+
 	SPI_MASTER->TASKS_START = 1;
 
-	k_sem_take(&spim_done, K_FOREVER);
+	k_sem_take(&spim1.done, K_FOREVER);
+
+	usleep(1);
 
 	/* CS: high. */
 	GPIO->OUTSET = 1 << PIN_CS;
@@ -136,33 +313,453 @@ int spim_recv(int size)
 	return SPI_MASTER->RXD.AMOUNT;
 }
 
-int spim_recv_delayed(int size)
+/* Let TIMER0 pull CS low on COMPARE0 and start the SPIM CONFIG_SPIM_CS_DELAY_US later on
+ * COMPARE1, END releases CS. The CPU only starts the timer and wakes up at the end.
+ */
+void spim_hw_cs_init(uint32_t bitrate)
+{
+	spim_init(bitrate);
+
+	/* CS: GPIOTE task, initially high. Takes over the pin from the GPIO configuration. */
+	CS_GPIOTE->CONFIG[CS_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Task |
+					  (PIN_CS << GPIOTE_CONFIG_PSEL_Pos) |
+					  (GPIOTE_CONFIG_OUTINIT_High << GPIOTE_CONFIG_OUTINIT_Pos);
+
+	/* 1 MHz, CS low after 1 us, START after the delay, then stop and rewind. */
+	CS_TIMER->MODE = TIMER_MODE_MODE_Timer;
+	CS_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	CS_TIMER->PRESCALER = 4;
+	CS_TIMER->CC[0] = 1;
+	CS_TIMER->CC[1] = 1 + CONFIG_SPIM_CS_DELAY_US;
+	CS_TIMER->SHORTS = TIMER_SHORTS_COMPARE1_STOP_Msk | TIMER_SHORTS_COMPARE1_CLEAR_Msk;
+	CS_TIMER->TASKS_CLEAR = 1;
+
+	CS_TIMER->PUBLISH_COMPARE[0] = TIMER_PUBLISH_COMPARE_EN_Msk | CS_DPPI_CHANNEL;
+	CS_GPIOTE->SUBSCRIBE_CLR[CS_GPIOTE_NR] = GPIOTE_SUBSCRIBE_CLR_EN_Msk | CS_DPPI_CHANNEL;
+	CS_TIMER->PUBLISH_COMPARE[1] = TIMER_PUBLISH_COMPARE_EN_Msk | START_DPPI_CHANNEL;
+	SPI_MASTER->SUBSCRIBE_START = SPIM_SUBSCRIBE_START_EN_Msk | START_DPPI_CHANNEL;
+	NRF_DPPIC->CHENSET = (1 << CS_DPPI_CHANNEL) | (1 << START_DPPI_CHANNEL);
+
+	/* END is already published for the timing measurement, release CS on it. Listed in
+	 * xfer_timing.h.
+	 */
+	CS_GPIOTE->SUBSCRIBE_SET[CS_GPIOTE_NR] = GPIOTE_SUBSCRIBE_SET_EN_Msk |
+						 XFER_TIMING_DPPI_END;
+
+	lp_printf("    CSN to CLK delay %d us\n", CONFIG_SPIM_CS_DELAY_US);
+}
+
+int spim_send_hw_cs(int size)
+{
+	SPI_MASTER->TXD.MAXCNT = size;
+	SPI_MASTER->RXD.MAXCNT = 0;
+
+	CS_TIMER->TASKS_START = 1;
+
+	k_sem_take(&spim1.done, K_FOREVER);
+
+	return SPI_MASTER->TXD.AMOUNT;
+}
+
+int spim_recv_hw_cs(int size)
 {
 	SPI_MASTER->TXD.MAXCNT = 0;
 	SPI_MASTER->RXD.MAXCNT = size;
 
+	CS_TIMER->TASKS_START = 1;
+
+	k_sem_take(&spim1.done, K_FOREVER);
+
+	return SPI_MASTER->RXD.AMOUNT;
+}
+
+/* Let END restart the CS timer so frames follow each other 'gap_us' apart without the CPU.
+ * Received frames alternate between two halves of rx_buffer, the STARTED interrupt moves
+ * the pointer and the END interrupt checks the frame that just ended.
+ */
+static int spim_burst(int frame_size, bool rx, int gap_us)
+{
+	int err = 0;
+
+	stream_ptr = rx ? &SPI_MASTER->RXD.PTR : &SPI_MASTER->TXD.PTR;
+	stream_base = rx ? rx_buffer : tx_buffer;
+	/* Every sent frame comes from the start of tx_buffer. */
+	stream_chunk_size = rx ? frame_size : 0;
+	stream_check = rx;
+	stream_errors = 0;
+	stream_ended = 0;
+	stream_chunks = BURST_FRAMES;
+
+	*stream_ptr = (int)stream_base;
+	SPI_MASTER->EVENTS_STARTED = 0;
+	SPI_MASTER->INTENSET = SPIM_INTENSET_STARTED_Msk;
+
+	/* The timing END channel starts the gap, listed in xfer_timing.h. */
+	CS_TIMER->CC[1] = gap_us;
+	CS_TIMER->SUBSCRIBE_START = TIMER_SUBSCRIBE_START_EN_Msk | XFER_TIMING_DPPI_END;
+	CS_TIMER->TASKS_START = 1;
+
+	if (k_sem_take(&spim1.done, K_SECONDS(10))) {
+		CS_TIMER->SUBSCRIBE_START = 0;
+		err = -ETIMEDOUT;
+	}
+
+	SPI_MASTER->INTENCLR = SPIM_INTENCLR_STARTED_Msk;
+	stream_chunks = 0;
+	stream_check = false;
+
+	return err;
+}
+
+/* Send bursts of frames with decreasing gaps to find the gap the slave can keep up with. */
+static int spim_burst_all(int size, bool rx)
+{
+	int frame_size = CLAMP(size, 2, sizeof(rx_buffer) / 2);
+	int err = 0;
+
+	lp_printf("Bursts of %d %s frames of %d bytes\n", BURST_FRAMES, rx ? "RX" : "TX",
+		  frame_size);
+
+	tx_buffer[0] = frame_size >> 8;
+	tx_buffer[1] = frame_size & 0xff;
+	SPI_MASTER->TXD.MAXCNT = rx ? 0 : frame_size;
+	SPI_MASTER->RXD.MAXCNT = rx ? frame_size : 0;
+
+	for (int i = 0; i < ARRAY_SIZE(burst_gaps_us); i++) {
+		uint32_t start = k_cycle_get_32();
+		uint64_t us;
+
+		err = spim_burst(frame_size, rx, burst_gaps_us[i]);
+		us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+		if (err) {
+			lp_printf("  gap %3u us: failed %d\n", burst_gaps_us[i], err);
+			break;
+		}
+
+		lp_printf("  gap %3u us: %d frames in %llu us, ", burst_gaps_us[i], BURST_FRAMES,
+			  us);
+		if (!rx) {
+			lp_printf("check the slave for overruns\n");
+		} else if (stream_errors) {
+			lp_printf(RED "%d frames overrun" NORMAL "\n", stream_errors);
+		} else {
+			lp_printf(GREEN "no overruns" NORMAL "\n");
+		}
+
+		/* Give the slave time to see the end of the burst. */
+		k_msleep(BURST_PAUSE_MS);
+	}
+
+	CS_TIMER->CC[1] = 1 + CONFIG_SPIM_CS_DELAY_US;
+	SPI_MASTER->TXD.PTR = (int)tx_buffer;
+	SPI_MASTER->RXD.PTR = (int)rx_buffer;
+
+	return err;
+}
+
+int spim_burst_send(int size)
+{
+	return spim_burst_all(size, false);
+}
+
+int spim_burst_recv(int size)
+{
+	return spim_burst_all(size, true);
+}
+
+void spim_hw_cs_deinit(void)
+{
+	NRF_DPPIC->CHENCLR = (1 << CS_DPPI_CHANNEL) | (1 << START_DPPI_CHANNEL);
+	CS_TIMER->TASKS_STOP = 1;
+	CS_TIMER->SUBSCRIBE_START = 0;
+	CS_TIMER->SHORTS = 0;
+	CS_TIMER->PUBLISH_COMPARE[0] = 0;
+	CS_TIMER->PUBLISH_COMPARE[1] = 0;
+	SPI_MASTER->SUBSCRIBE_START = 0;
+	CS_GPIOTE->SUBSCRIBE_CLR[CS_GPIOTE_NR] = 0;
+	CS_GPIOTE->SUBSCRIBE_SET[CS_GPIOTE_NR] = 0;
+
+	/* Hand CS back to the GPIO configuration (high) before it is disconnected. */
+	CS_GPIOTE->CONFIG[CS_GPIOTE_NR] = 0;
+
+	spim_deinit();
+}
+
+static const struct {
+	uint32_t frequency;
+	uint32_t bps;
+} stream_frequencies[] = {
+	{SPIM_FREQUENCY_FREQUENCY_K125, 125000},
+	{SPIM_FREQUENCY_FREQUENCY_K250, 250000},
+	{SPIM_FREQUENCY_FREQUENCY_K500, 500000},
+	{SPIM_FREQUENCY_FREQUENCY_M1, 1000000},
+	{SPIM_FREQUENCY_FREQUENCY_M2, 2000000},
+	{SPIM_FREQUENCY_FREQUENCY_M4, 4000000},
+	{SPIM_FREQUENCY_FREQUENCY_M8, 8000000},
+};
+
+/* Move 'chunks' DMA halves of 'chunk_size' back-to-back without releasing CS.
+ * END_START restarts the SPIM immediately, the STARTED interrupt moves the pointer to the
+ * other half while the current one is on the wire.
+ */
+static int spim_stream(volatile uint32_t *ptr, uint8_t *buffer, int chunk_size, int chunks)
+{
+	int err = 0;
+
+	stream_ptr = ptr;
+	stream_base = buffer;
+	stream_chunk_size = chunk_size;
+	stream_ended = 0;
+	stream_chunks = chunks;
+
+	*stream_ptr = (int)buffer;
+	SPI_MASTER->EVENTS_STARTED = 0;
+	SPI_MASTER->INTENSET = SPIM_INTENSET_STARTED_Msk;
+	SPI_MASTER->SHORTS = chunks > 1 ? SPIM_SHORTS_END_START_Msk : 0;
+
 	/* CS: low. */
 	GPIO->OUTCLR = 1 << PIN_CS;
 
-	usleep(80);
-
 	SPI_MASTER->TASKS_START = 1;
 
-	k_sem_take(&spim_done, K_FOREVER);
-
-	usleep(1);
+	if (k_sem_take(&spim1.done, K_SECONDS(4 * STREAM_SECONDS))) {
+		/* Lost track of the chunks, stop whatever is on the wire. */
+		SPI_MASTER->SHORTS = 0;
+		SPI_MASTER->TASKS_STOP = 1;
+		err = -ETIMEDOUT;
+	}
 
 	/* CS: high. */
 	GPIO->OUTSET = 1 << PIN_CS;
 
-	return SPI_MASTER->RXD.AMOUNT;
+	SPI_MASTER->INTENCLR = SPIM_INTENCLR_STARTED_Msk;
+	stream_chunks = 0;
+
+	/* Restore the single transfer configuration. */
+	SPI_MASTER->TXD.PTR = (int)tx_buffer;
+	SPI_MASTER->RXD.PTR = (int)rx_buffer;
+	SPI_MASTER->FREQUENCY = spim_bitrate;
+
+	return err;
+}
+
+/* Stream at every frequency in DMA halves of 'size' bytes and report the sustained rate. */
+static int spim_stream_all(int size, bool tx)
+{
+	int chunk_size = CLAMP(size, STREAM_MIN_CHUNK, sizeof(tx_buffer) / 2);
+
+	lp_printf("Streaming %s in chunks of %d bytes\n", tx ? "TX" : "RX", chunk_size);
+
+	SPI_MASTER->TXD.MAXCNT = tx ? chunk_size : 0;
+	SPI_MASTER->RXD.MAXCNT = tx ? 0 : chunk_size;
+
+	for (int i = 0; i < ARRAY_SIZE(stream_frequencies); i++) {
+		uint32_t bps = stream_frequencies[i].bps;
+		int chunks = bps / 8 * STREAM_SECONDS / chunk_size;
+		uint64_t bytes = (uint64_t)chunks * chunk_size;
+		uint32_t start;
+		uint64_t us;
+		int err;
+
+		SPI_MASTER->FREQUENCY = stream_frequencies[i].frequency;
+
+		start = k_cycle_get_32();
+		if (tx) {
+			err = spim_stream(&SPI_MASTER->TXD.PTR, tx_buffer, chunk_size, chunks);
+		} else {
+			err = spim_stream(&SPI_MASTER->RXD.PTR, rx_buffer, chunk_size, chunks);
+		}
+		us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+		if (err) {
+			lp_printf("  %7u bps: failed %d\n", bps, err);
+			return err;
+		}
+
+		lp_printf("  %7u bps: %llu bytes in %llu us, %llu bytes/s (%llu%% of line rate)\n",
+			  bps, bytes, us, bytes * 1000000 / us, bytes * 8 * 100 * 1000000 / us / bps);
+	}
+
+	return 0;
+}
+
+int spim_stream_send(int size)
+{
+	return spim_stream_all(size, true);
+}
+
+int spim_stream_recv(int size)
+{
+	return spim_stream_all(size, false);
+}
+
+void spim_instance_deinit(struct spim_instance *spim)
+{
+	irq_disable(spim->irq);
+	spim->regs->INTENCLR = SPIM_INTENCLR_END_Msk;
+	spim->regs->PUBLISH_STARTED = 0;
+	spim->regs->PUBLISH_END = 0;
+	GPIO->PIN_CNF[spim->pin_sck] = 0;
+	GPIO->PIN_CNF[spim->pin_mosi] = 0;
+	GPIO->PIN_CNF[spim->pin_cs] = 0;
+	spim->regs->ENABLE = 0;
 }
 
 void spim_deinit(void)
 {
-	SPI_MASTER->INTENCLR = SPIM_INTENCLR_END_Msk;
-	GPIO->PIN_CNF[PIN_SCK] = 0;
-	GPIO->PIN_CNF[2] = 0;
-	GPIO->PIN_CNF[PIN_CS] = 0;
-	SPI_MASTER->ENABLE = 0;
+	spim_instance_deinit(&spim1);
+}
+
+/* Print a bit error rate as "<mantissa>e-<exponent>" without floating point. */
+static void ber_print(uint64_t errors, uint64_t bits)
+{
+	int exponent = 0;
+
+	if (!errors) {
+		while (bits >= 10) {
+			bits /= 10;
+			exponent++;
+		}
+		lp_printf("BER < 1e-%d", exponent);
+		return;
+	}
+
+	/* Scale so that errors * 10^exponent / bits is in [1, 10). */
+	while (errors < bits) {
+		errors *= 10;
+		exponent++;
+	}
+	lp_printf("BER %llu.%02llue-%d", errors / bits, errors * 100 / bits % 100, exponent);
+}
+
+/* Send 'chunks' chunks of the pattern back-to-back and check what comes back on MISO. The
+ * thread checks a finished half and fills it with the chunk after next while the next chunk
+ * is on the wire. Returns -EOVERFLOW if that took longer than a chunk.
+ */
+static int spim_ber_run(enum pattern_type type, int chunk_size, int chunks, uint64_t *errors)
+{
+	struct pattern tx_pattern;
+	struct pattern rx_pattern;
+	int checked = 0;
+	int err = 0;
+
+	pattern_init(&tx_pattern, type);
+	pattern_init(&rx_pattern, type);
+	pattern_fill(&tx_pattern, tx_buffer, 2 * chunk_size);
+
+	stream_ptr = &SPI_MASTER->TXD.PTR;
+	stream_base = tx_buffer;
+	stream_rx_ptr = &SPI_MASTER->RXD.PTR;
+	stream_rx_base = rx_buffer;
+	stream_chunk_size = chunk_size;
+	stream_ended = 0;
+	stream_chunks = chunks;
+	k_sem_reset(&stream_chunk);
+
+	SPI_MASTER->TXD.PTR = (int)tx_buffer;
+	SPI_MASTER->RXD.PTR = (int)rx_buffer;
+	SPI_MASTER->TXD.MAXCNT = chunk_size;
+	SPI_MASTER->RXD.MAXCNT = chunk_size;
+	SPI_MASTER->EVENTS_STARTED = 0;
+	SPI_MASTER->INTENSET = SPIM_INTENSET_STARTED_Msk;
+	SPI_MASTER->SHORTS = chunks > 1 ? SPIM_SHORTS_END_START_Msk : 0;
+
+	/* CS: low. */
+	GPIO->OUTCLR = 1 << PIN_CS;
+
+	SPI_MASTER->TASKS_START = 1;
+
+	while (checked < chunks) {
+		int half = (checked & 1) * chunk_size;
+
+		if (checked == stream_ended) {
+			if (k_sem_take(&stream_chunk, K_MSEC(100))) {
+				err = -ETIMEDOUT;
+				break;
+			}
+			continue;
+		}
+
+		*errors += pattern_check(&rx_pattern, &rx_buffer[half], chunk_size);
+		if (checked + 2 < chunks) {
+			pattern_fill(&tx_pattern, &tx_buffer[half], chunk_size);
+		}
+		checked++;
+
+		/* The chunk after next has started from this half already. */
+		if (stream_ended > checked && checked + 1 < chunks) {
+			err = -EOVERFLOW;
+			break;
+		}
+	}
+
+	if (err) {
+		SPI_MASTER->SHORTS = 0;
+		SPI_MASTER->TASKS_STOP = 1;
+		k_busy_wait(100);
+	} else {
+		k_sem_take(&spim1.done, K_MSEC(100));
+	}
+
+	/* CS: high. */
+	GPIO->OUTSET = 1 << PIN_CS;
+
+	SPI_MASTER->INTENCLR = SPIM_INTENCLR_STARTED_Msk;
+	SPI_MASTER->SHORTS = 0;
+	stream_chunks = 0;
+	stream_rx_ptr = NULL;
+
+	/* Restore the single transfer configuration. */
+	SPI_MASTER->TXD.PTR = (int)tx_buffer;
+	SPI_MASTER->RXD.PTR = (int)rx_buffer;
+
+	return err;
+}
+
+/* Bit error soak over a wire from MOSI to MISO, every pattern for CONFIG_BER_SECONDS. */
+int spim_ber(int size)
+{
+	int chunk_size = CLAMP(size, STREAM_MIN_CHUNK, sizeof(tx_buffer) / 2);
+	uint32_t bps = 0;
+	int err = 0;
+
+	for (int i = 0; i < ARRAY_SIZE(stream_frequencies); i++) {
+		if (stream_frequencies[i].frequency == spim_bitrate) {
+			bps = stream_frequencies[i].bps;
+		}
+	}
+	if (!bps) {
+		return -EINVAL;
+	}
+
+	lp_printf("BER soak at %u bps in chunks of %d bytes, connect P0.%02d to P0.%02d\n", bps,
+		  chunk_size, spim1.pin_mosi, spim1.pin_miso);
+
+	for (int type = 0; type < PATTERN_COUNT; type++) {
+		int chunks = (uint64_t)bps / 8 * CONFIG_BER_SECONDS / chunk_size;
+		uint64_t bits = (uint64_t)chunks * chunk_size * 8;
+		uint64_t errors = 0;
+
+		err = spim_ber_run(type, chunk_size, chunks, &errors);
+
+		lp_printf("  %-12s ", pattern_names[type]);
+		if (err == -EOVERFLOW) {
+			lp_printf(RED "checking is slower than the bus, use larger chunks\n" NORMAL);
+			break;
+		} else if (err) {
+			lp_printf(RED "failed %d\n" NORMAL, err);
+			break;
+		}
+
+		lp_printf("%llu bits, %s%llu bit errors" NORMAL ", ", bits, errors ? RED : GREEN,
+			  errors);
+		ber_print(errors, bits);
+		lp_printf("\n");
+	}
+
+	/* Back to the pattern of the other tests. */
+	tx_pattern_restore();
+
+	return err;
 }
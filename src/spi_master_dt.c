@@ -36,6 +36,10 @@ void init(void)
 	lp_printf("    CS      P0.%02d\n", spi_cfg.cs.gpio.pin);
 
 	pm_device_action_run(p_dev, PM_DEVICE_ACTION_RESUME);
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	SPI_MASTER->PUBLISH_STARTED = SPIM_PUBLISH_STARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	SPI_MASTER->PUBLISH_END = SPIM_PUBLISH_END_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 int send(int size)
@@ -74,9 +78,177 @@ int recv(int size)
 	return err == 0 ? size : err;
 }
 
+#define HAVE_TRANSCEIVE
+
+int transceive(int tx_size, int rx_size)
+{
+	int err;
+
+	const struct spi_buf tx_buf = {
+		.buf = tx_buffer,
+		.len = tx_size
+	};
+	const struct spi_buf_set tx = {
+		.buffers = &tx_buf,
+		.count = 1
+	};
+	struct spi_buf rx_buf = {
+		.buf = rx_buffer,
+		.len = rx_size,
+	};
+	const struct spi_buf_set rx = {
+		.buffers = &rx_buf,
+		.count = 1
+	};
+
+	err = spi_transceive(p_dev, &spi_cfg, &tx, &rx);
+
+	return err == 0 ? rx_size : err;
+}
+
 void deinit(void)
 {
+	SPI_MASTER->PUBLISH_STARTED = 0;
+	SPI_MASTER->PUBLISH_END = 0;
 	spi_release(p_dev, &spi_cfg);
 	/* Suspend is needed to re-initialise SPIM so we can change the frequency. */
 	pm_device_action_run(p_dev, PM_DEVICE_ACTION_SUSPEND);
 }
+
+/* Frames of the sync/async comparison: a 4 byte header [length][sequence number] and the
+ * payload, sent as a scatter-gather list of two buffers. Two slots let the next frame be
+ * prepared while the current one is on the wire.
+ */
+#define PIPELINE_FRAMES 1000
+#define PIPELINE_HEADER 4
+
+static uint8_t pipeline_headers[2][PIPELINE_HEADER];
+static struct spi_buf pipeline_bufs[2][2];
+static struct spi_buf_set pipeline_sets[2];
+static atomic_t pipeline_completed;
+static atomic_t pipeline_errors;
+
+K_SEM_DEFINE(pipeline_done, 0, 1);
+
+static void pipeline_prepare(int seq, int size)
+{
+	int slot = seq & 1;
+	int payload = size - PIPELINE_HEADER;
+
+	pipeline_headers[slot][0] = size >> 8;
+	pipeline_headers[slot][1] = size & 0xff;
+	pipeline_headers[slot][2] = seq >> 8;
+	pipeline_headers[slot][3] = seq & 0xff;
+
+	pipeline_bufs[slot][0].buf = pipeline_headers[slot];
+	pipeline_bufs[slot][0].len = PIPELINE_HEADER;
+	pipeline_bufs[slot][1].buf = &tx_buffer[slot * payload];
+	pipeline_bufs[slot][1].len = payload;
+	pipeline_sets[slot].buffers = pipeline_bufs[slot];
+	pipeline_sets[slot].count = 2;
+}
+
+static void pipeline_callback(const struct device *dev, int result, void *data)
+{
+	if (result) {
+		atomic_inc(&pipeline_errors);
+	}
+	if (atomic_inc(&pipeline_completed) + 1 == PIPELINE_FRAMES) {
+		k_sem_give(&pipeline_done);
+	}
+}
+
+/* Each call returns when the frame is on the wire: the driver lock is only free once the
+ * previous frame has ended, so the slot of the frame before is free again.
+ */
+static int pipeline_async(int size)
+{
+	atomic_set(&pipeline_completed, 0);
+	atomic_set(&pipeline_errors, 0);
+	k_sem_reset(&pipeline_done);
+
+	pipeline_prepare(0, size);
+	for (int seq = 0; seq < PIPELINE_FRAMES; seq++) {
+		int err = spi_transceive_cb(p_dev, &spi_cfg, &pipeline_sets[seq & 1], NULL,
+					    pipeline_callback, NULL);
+
+		if (err) {
+			return err;
+		}
+		if (seq + 1 < PIPELINE_FRAMES) {
+			pipeline_prepare(seq + 1, size);
+		}
+	}
+
+	if (k_sem_take(&pipeline_done, K_SECONDS(10))) {
+		return -ETIMEDOUT;
+	}
+
+	return atomic_get(&pipeline_errors) ? -EIO : 0;
+}
+
+static int pipeline_sync(int size)
+{
+	for (int seq = 0; seq < PIPELINE_FRAMES; seq++) {
+		int err;
+
+		pipeline_prepare(seq, size);
+		err = spi_write(p_dev, &spi_cfg, &pipeline_sets[seq & 1]);
+		if (err) {
+			return err;
+		}
+	}
+
+	return 0;
+}
+
+/* Send PIPELINE_FRAMES frames of 'size' bytes through the blocking and the callback API and
+ * compare throughput and the time the CPU was awake.
+ */
+int pipeline_compare(int size)
+{
+	static const char *const labels[] = {"Sync", "Async"};
+	int (*const runs[])(int size) = {pipeline_sync, pipeline_async};
+	bool cpu_time = xfer_timing_cycles_init();
+
+	if (size <= PIPELINE_HEADER || 2 * (size - PIPELINE_HEADER) > sizeof(tx_buffer)) {
+		return -EINVAL;
+	}
+
+	lp_printf("%d frames of %d bytes\n", PIPELINE_FRAMES, size);
+	lp_printf("API     Bytes/s  Frames/s  CPU us  CPU %%\n");
+
+	for (int i = 0; i < ARRAY_SIZE(runs); i++) {
+		uint32_t start = k_cycle_get_32();
+		uint32_t cpu_start = xfer_timing_cycles();
+		uint32_t cpu_us;
+		uint32_t us;
+		int err;
+
+		err = runs[i](size);
+
+		cpu_us = xfer_timing_cycles_to_us(xfer_timing_cycles() - cpu_start);
+		us = MAX(k_cyc_to_us_floor32(k_cycle_get_32() - start), 1);
+
+		if (err) {
+			lp_printf("%-5s  failed %d\n", labels[i], err);
+			return err;
+		}
+
+		lp_printf("%-5s  %8llu  %8llu  ", labels[i],
+			  (uint64_t)PIPELINE_FRAMES * size * 1000000 / us,
+			  (uint64_t)PIPELINE_FRAMES * 1000000 / us);
+		if (cpu_time) {
+			lp_printf("%6u  %4u%%\n", cpu_us, (uint32_t)((uint64_t)cpu_us * 100 / us));
+		} else {
+			lp_printf("   n/a    n/a\n");
+		}
+	}
+
+	return 0;
+}
+
+/* Added to the test menu of this backend. */
+#define BACKEND_TESTS \
+	{"Sync vs async API, 16 byte frames", 16, pipeline_compare}, \
+	{"Sync vs async API, 256 byte frames", 256, pipeline_compare},
@@ -9,101 +9,326 @@
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
-#define SPI_SLAVE NRF_SPIS1_NS
+#include "bus.h"
+#include "serial_irq.h"
+#include "stats.h"
+#include "term_color.h"
+#include "xfer_timing.h"
+
+/* Streaming uses instance 1. */
+#define SPI_SLAVE spis1.regs
 #define GPIO      NRF_P0_NS
-#define PIN_SCK    6
-#define PIN_MISO   3
-#define PIN_MOSI   2
-#define PIN_CS     7
 
-extern uint8_t tx_buffer[1024];
-extern uint8_t rx_buffer[2048];
+/* The master side is started by hand. */
+#define TRANSFER_TIMEOUT K_SECONDS(60)
+
+/* Measures how long the CPU holds the semaphore between two streamed frames. */
+#define GAP_TIMER  NRF_TIMER2_NS
+#define GAP_TIMER_MHZ 16
+/* Bursts end when the master has been quiet this long. */
+#define STREAM_IDLE_SECONDS 1
+#define STREAM_MAX_SAMPLES  1000
 
-K_SEM_DEFINE(spis_done, 0, 1);
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
 
 int lp_printf(const char *fmt, ...);
 
-static void spis_isr(const void *arg)
+struct spis_instance spis1 = {
+	.regs = NRF_SPIS1_NS,
+	.irq = SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn,
+	.pin_sck = 6,
+	.pin_mosi = 2,
+	.pin_miso = 3,
+	.pin_cs = 7,
+	.tx_buffer = tx_buffer,
+	.rx_buffer = rx_buffer,
+};
+
+/* Streaming state, two buffer pairs in the halves of tx_buffer and rx_buffer. */
+static bool stream_active;
+static bool stream_rx;
+static int stream_size;
+static int stream_pair;
+static volatile int stream_frames;
+static volatile int stream_errors;
+static uint32_t stream_gap[STREAM_MAX_SAMPLES];
+
+#define STREAM_PAIR_SIZE (sizeof(tx_buffer) / 2)
+
+/* The CPU got the semaphore after END (END_ACQUIRE), hand the other pair to the SPIS and
+ * release it again before looking at the finished frame.
+ */
+static void spis_stream_isr(void)
 {
+	int done = stream_pair;
+	uint8_t *frame = (stream_rx ? rx_buffer : tx_buffer) + done * STREAM_PAIR_SIZE;
+	int amount = stream_rx ? SPI_SLAVE->RXD.AMOUNT : SPI_SLAVE->TXD.AMOUNT;
+
+	SPI_SLAVE->EVENTS_ACQUIRED = 0;
 	SPI_SLAVE->EVENTS_END = 0;
-	k_sem_give(&spis_done);
+
+	stream_pair ^= 1;
+	SPI_SLAVE->TXD.PTR = (int)tx_buffer + stream_pair * STREAM_PAIR_SIZE;
+	SPI_SLAVE->RXD.PTR = (int)rx_buffer + stream_pair * STREAM_PAIR_SIZE;
+	SPI_SLAVE->TASKS_RELEASE = 1;
+	GAP_TIMER->TASKS_CAPTURE[1] = 1;
+
+	/* END was captured in CC[0] through DPPI. */
+	if (stream_frames < STREAM_MAX_SAMPLES) {
+		stream_gap[stream_frames] = GAP_TIMER->CC[1] - GAP_TIMER->CC[0];
+	}
+
+	/* Only the header and the last byte, a full compare would delay the next frame. */
+	if (amount != stream_size || (stream_rx &&
+	    ((frame[0] << 8) + frame[1] != stream_size ||
+	     frame[stream_size - 1] != ((stream_size - 1) & 0xff)))) {
+		stream_errors++;
+	}
+
+	stream_frames++;
+	k_sem_give(&spis1.done);
 }
 
-void spis_init(uint32_t bitrate)
+static void spis_isr(const void *arg)
+{
+	struct spis_instance *spis = (struct spis_instance *)arg;
+
+	/* Streaming only runs on instance 1. */
+	if (spis == &spis1 && stream_active) {
+		spis_stream_isr();
+		return;
+	}
+
+	spis->regs->EVENTS_END = 0;
+	k_sem_give(&spis->done);
+}
+
+void spis_instance_init(struct spis_instance *spis, uint32_t bitrate)
 {
+	NRF_SPIS_Type *regs = spis->regs;
+
+	k_sem_init(&spis->done, 0, 1);
+
 	/* SCK: Dir input, input connect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SCK] = 0;
+	GPIO->PIN_CNF[spis->pin_sck] = 0;
 	/* MOSI: Dir input, input connect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_MOSI] = 0;
+	GPIO->PIN_CNF[spis->pin_mosi] = 0;
 	/* CSN: Dir input, input connect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_CS] = 0;
+	GPIO->PIN_CNF[spis->pin_cs] = 0;
 
 	/* Configure pins. */
-	SPI_SLAVE->PSEL.SCK = PIN_SCK;
-	SPI_SLAVE->PSEL.MISO = PIN_MISO;
-	SPI_SLAVE->PSEL.MOSI = PIN_MOSI;
-	SPI_SLAVE->PSEL.CSN = PIN_CS;
+	regs->PSEL.SCK = spis->pin_sck;
+	regs->PSEL.MISO = spis->pin_miso;
+	regs->PSEL.MOSI = spis->pin_mosi;
+	regs->PSEL.CSN = spis->pin_cs;
 
 	/* Configure buffers. */
-	SPI_SLAVE->RXD.PTR = (int)rx_buffer;
-	SPI_SLAVE->TXD.PTR = (int)tx_buffer;
+	regs->RXD.PTR = (int)spis->rx_buffer;
+	regs->TXD.PTR = (int)spis->tx_buffer;
 
 	/* Most significant bit first, Sample on trailing edge, Active low.  */
-	SPI_SLAVE->CONFIG = SPIS_CONFIG_CPOL_Msk | SPIS_CONFIG_CPHA_Msk;
+	regs->CONFIG = SPIS_CONFIG_CPOL_Msk | SPIS_CONFIG_CPHA_Msk;
 
 	/* Equire semaphore on end of transmission. */
-	SPI_SLAVE->SHORTS = SPIS_SHORTS_END_ACQUIRE_Msk;
+	regs->SHORTS = SPIS_SHORTS_END_ACQUIRE_Msk;
 
 	/* Enable interrupt to wake up at the end of a message. */
-	SPI_SLAVE->INTENSET = SPIS_INTENSET_END_Msk;
-	irq_connect_dynamic(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, 0, spis_isr, NULL, 0);
-	irq_enable(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn);
+	regs->INTENSET = SPIS_INTENSET_END_Msk;
+
+	/* Publish end of a transfer for the timing measurement, SPIS has no start event. */
+	regs->PUBLISH_END = SPIS_PUBLISH_END_EN_Msk | XFER_TIMING_DPPI_END;
+
+	serial_irq_connect(spis->irq, spis_isr, spis);
+	irq_enable(spis->irq);
 
 	/* Enable. */
-	SPI_SLAVE->ENABLE = SPIS_ENABLE_ENABLE_Enabled;
+	regs->ENABLE = SPIS_ENABLE_ENABLE_Enabled;
 
 	/* MISO: Dir output, input disconnect, pull disabled, drive h0h1, sense disabled. */
-	GPIO->PIN_CNF[PIN_MISO] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
-				  (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-				  (GPIO_PIN_CNF_DRIVE_H0H1 << GPIO_PIN_CNF_DRIVE_Pos);
-
-	lp_printf("    SCK     P0.%02d\n", PIN_SCK);
-	lp_printf("    MOSI    P0.%02d\n", PIN_MOSI);
-	lp_printf("    MISO    P0.%02d\n", PIN_MISO);
-	lp_printf("    CS      P0.%02d\n", PIN_CS);
+	GPIO->PIN_CNF[spis->pin_miso] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+					(GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+					(GPIO_PIN_CNF_DRIVE_H0H1 << GPIO_PIN_CNF_DRIVE_Pos);
+
+	lp_printf("    SCK     P0.%02d\n", spis->pin_sck);
+	lp_printf("    MOSI    P0.%02d\n", spis->pin_mosi);
+	lp_printf("    MISO    P0.%02d\n", spis->pin_miso);
+	lp_printf("    CS      P0.%02d\n", spis->pin_cs);
 }
 
-int spis_send(int size)
+void spis_init(uint32_t bitrate)
 {
-	SPI_SLAVE->TXD.MAXCNT = size;
-	SPI_SLAVE->RXD.MAXCNT = 0;
-	SPI_SLAVE->TASKS_RELEASE = 1;
+	spis_instance_init(&spis1, bitrate);
+}
 
-	if (k_sem_take(&spis_done,  K_SECONDS(60))) {
-		SPI_SLAVE->TASKS_ACQUIRE = 1;
+/* Hand both buffers to the SPIS and wait until the master has ended the transaction. Returns
+ * the number of bytes clocked.
+ */
+int spis_instance_transfer(struct spis_instance *spis, int tx_size, int rx_size,
+			   k_timeout_t timeout)
+{
+	NRF_SPIS_Type *regs = spis->regs;
+
+	regs->TXD.MAXCNT = tx_size;
+	regs->RXD.MAXCNT = rx_size;
+	regs->TASKS_RELEASE = 1;
+
+	if (k_sem_take(&spis->done, timeout)) {
+		regs->TASKS_ACQUIRE = 1;
 		return -ETIMEDOUT;
 	}
 
-	return SPI_SLAVE->TXD.AMOUNT;
+	return MAX(regs->TXD.AMOUNT, regs->RXD.AMOUNT);
+}
+
+int spis_send(int size)
+{
+	int ret = spis_instance_transfer(&spis1, size, 0, TRANSFER_TIMEOUT);
+
+	return ret < 0 ? ret : SPI_SLAVE->TXD.AMOUNT;
 }
 
 int spis_recv(int size)
 {
-	SPI_SLAVE->TXD.MAXCNT = 0;
-	SPI_SLAVE->RXD.MAXCNT = size;
-	SPI_SLAVE->TASKS_RELEASE = 1;
+	int ret = spis_instance_transfer(&spis1, 0, size, TRANSFER_TIMEOUT);
 
-	if (k_sem_take(&spis_done,  K_SECONDS(60))) {
-		SPI_SLAVE->TASKS_ACQUIRE = 1;
-		return -ETIMEDOUT;
+	return ret < 0 ? ret : SPI_SLAVE->RXD.AMOUNT;
+}
+
+/* Full-duplex, returns the number of bytes received or -EIO if the master clocked out less
+ * than tx_size bytes.
+ */
+int spis_transceive(int tx_size, int rx_size)
+{
+	int ret = spis_instance_transfer(&spis1, tx_size, rx_size, TRANSFER_TIMEOUT);
+
+	if (ret < 0) {
+		return ret;
+	}
+	if (SPI_SLAVE->TXD.AMOUNT != tx_size) {
+		return -EIO;
 	}
 
 	return SPI_SLAVE->RXD.AMOUNT;
 }
 
-void spis_deinit(void)
+/* Print the frames of one burst and how fast the semaphore was handed back. */
+static void spis_stream_report(int frames, int errors)
 {
+	int samples = MIN(frames, STREAM_MAX_SAMPLES);
+	struct stats stats;
+
+	stats_calc(stream_gap, samples, &stats);
+
+	lp_printf("  %d frames of %d bytes, ", frames, stream_size);
+	if (errors) {
+		lp_printf(RED "%d errors" NORMAL, errors);
+	} else {
+		lp_printf(GREEN "no errors" NORMAL);
+	}
+	lp_printf(", END to RELEASE min %u p50 %u p99 %u max %u ns\n",
+		  stats.min * 1000 / GAP_TIMER_MHZ, stats.p50 * 1000 / GAP_TIMER_MHZ,
+		  stats.p99 * 1000 / GAP_TIMER_MHZ, stats.max * 1000 / GAP_TIMER_MHZ);
+	lp_printf("  Minimum inter-frame gap without overrun %u ns\n",
+		  stats.max * 1000 / GAP_TIMER_MHZ);
+}
+
+/* Accept back-to-back frames of 'size' bytes until the master pauses, then report every
+ * burst. Ends when no burst follows within 10 s (60 s for the first one).
+ */
+static int spis_stream(int size, bool rx)
+{
+	k_timeout_t timeout = K_SECONDS(60);
+	int bursts = 0;
+
+	stream_size = CLAMP(size, 2, STREAM_PAIR_SIZE);
+	stream_rx = rx;
+
+	/* Both pairs carry a full packet when sending, the pattern repeats every 256 bytes. */
+	for (int pair = 0; pair < 2; pair++) {
+		tx_buffer[pair * STREAM_PAIR_SIZE] = stream_size >> 8;
+		tx_buffer[pair * STREAM_PAIR_SIZE + 1] = stream_size & 0xff;
+	}
+
+	/* 16 MHz, capture END in hardware on the timing END channel (listed in xfer_timing.h),
+	 * RELEASE from the interrupt.
+	 */
+	GAP_TIMER->MODE = TIMER_MODE_MODE_Timer;
+	GAP_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	GAP_TIMER->PRESCALER = 0;
+	GAP_TIMER->SUBSCRIBE_CAPTURE[0] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | XFER_TIMING_DPPI_END;
+	GAP_TIMER->TASKS_CLEAR = 1;
+	GAP_TIMER->TASKS_START = 1;
+
+	k_sem_reset(&spis1.done);
+	stream_pair = 0;
+	stream_active = true;
 	SPI_SLAVE->INTENCLR = SPIS_INTENCLR_END_Msk;
-	GPIO->PIN_CNF[PIN_MISO] = 0;
-	SPI_SLAVE->ENABLE = 0;
+	SPI_SLAVE->EVENTS_ACQUIRED = 0;
+	SPI_SLAVE->INTENSET = SPIS_INTENSET_ACQUIRED_Msk;
+	SPI_SLAVE->TXD.MAXCNT = rx ? 0 : stream_size;
+	SPI_SLAVE->RXD.MAXCNT = rx ? stream_size : 0;
+
+	lp_printf("Streaming %s frames of %d bytes\n", rx ? "RX" : "TX", stream_size);
+
+	SPI_SLAVE->TASKS_RELEASE = 1;
+
+	while (1) {
+		/* The master is quiet between bursts. */
+		stream_frames = 0;
+		stream_errors = 0;
+
+		if (k_sem_take(&spis1.done, timeout)) {
+			break;
+		}
+		while (k_sem_take(&spis1.done, K_SECONDS(STREAM_IDLE_SECONDS)) == 0) {
+		}
+
+		spis_stream_report(stream_frames, stream_errors);
+		bursts++;
+		timeout = K_SECONDS(10);
+	}
+
+	/* Take the semaphore back and restore single transfers. */
+	SPI_SLAVE->INTENCLR = SPIS_INTENCLR_ACQUIRED_Msk;
+	SPI_SLAVE->TASKS_ACQUIRE = 1;
+	while (!SPI_SLAVE->EVENTS_ACQUIRED) {
+	}
+	SPI_SLAVE->EVENTS_ACQUIRED = 0;
+	stream_active = false;
+	SPI_SLAVE->EVENTS_END = 0;
+	SPI_SLAVE->INTENSET = SPIS_INTENSET_END_Msk;
+	SPI_SLAVE->TXD.PTR = (int)tx_buffer;
+	SPI_SLAVE->RXD.PTR = (int)rx_buffer;
+	tx_buffer[STREAM_PAIR_SIZE] = STREAM_PAIR_SIZE & 0xff;
+	tx_buffer[STREAM_PAIR_SIZE + 1] = (STREAM_PAIR_SIZE + 1) & 0xff;
+
+	GAP_TIMER->TASKS_STOP = 1;
+	GAP_TIMER->SUBSCRIBE_CAPTURE[0] = 0;
+
+	return bursts ? 0 : -ETIMEDOUT;
+}
+
+int spis_stream_send(int size)
+{
+	return spis_stream(size, false);
+}
+
+int spis_stream_recv(int size)
+{
+	return spis_stream(size, true);
+}
+
+void spis_instance_deinit(struct spis_instance *spis)
+{
+	irq_disable(spis->irq);
+	spis->regs->INTENCLR = SPIS_INTENCLR_END_Msk;
+	spis->regs->PUBLISH_END = 0;
+	GPIO->PIN_CNF[spis->pin_miso] = 0;
+	spis->regs->ENABLE = 0;
+}
+
+void spis_deinit(void)
+{
+	spis_instance_deinit(&spis1);
 }
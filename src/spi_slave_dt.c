@@ -26,6 +26,9 @@ void init(void)
 	lp_printf("    MOSI    P0.%02d\n", SPI_SLAVE->PSEL.MOSI);
 	lp_printf("    MISO    P0.%02d\n", SPI_SLAVE->PSEL.MISO);
 	lp_printf("    CS      P0.%02d\n", SPI_SLAVE->PSEL.CSN);
+
+	/* Publish end of a transfer for the timing measurement, SPIS has no start event. */
+	SPI_SLAVE->PUBLISH_END = SPIS_PUBLISH_END_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 static const struct spi_config spi_cfg = {
@@ -64,7 +67,32 @@ int recv(int size)
 	return spi_read(p_dev, &spi_cfg, &rx);
 }
 
-void deinit(void)
+#define HAVE_TRANSCEIVE
+
+/* In slave mode spi_transceive() returns the number of bytes received. */
+int transceive(int tx_size, int rx_size)
 {
+	const struct spi_buf tx_buf = {
+		.buf = tx_buffer,
+		.len = tx_size
+	};
+	const struct spi_buf_set tx = {
+		.buffers = &tx_buf,
+		.count = 1
+	};
+	struct spi_buf rx_buf = {
+		.buf = rx_buffer,
+		.len = rx_size
+	};
+	const struct spi_buf_set rx = {
+		.buffers = &rx_buf,
+		.count = 1
+	};
+
+	return spi_transceive(p_dev, &spi_cfg, &tx, &rx);
+}
 
+void deinit(void)
+{
+	SPI_SLAVE->PUBLISH_END = 0;
 }
@@ -0,0 +1,43 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "stats.h"
+
+static int compare(const void *a, const void *b)
+{
+	uint32_t x = *(const uint32_t *)a;
+	uint32_t y = *(const uint32_t *)b;
+
+	return (x > y) - (x < y);
+}
+
+/* Nearest-rank percentile of sorted samples. */
+static uint32_t percentile(const uint32_t *sorted, int count, int percent)
+{
+	int rank = (percent * count + 99) / 100;
+
+	return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void stats_calc(uint32_t *samples, int count, struct stats *stats)
+{
+	if (count == 0) {
+		memset(stats, 0, sizeof(*stats));
+		return;
+	}
+
+	qsort(samples, count, sizeof(samples[0]), compare);
+
+	stats->min = samples[0];
+	stats->p50 = percentile(samples, count, 50);
+	stats->p90 = percentile(samples, count, 90);
+	stats->p99 = percentile(samples, count, 99);
+	stats->max = samples[count - 1];
+}
@@ -0,0 +1,24 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+
+struct stats {
+	uint32_t min;
+	uint32_t p50;
+	uint32_t p90;
+	uint32_t p99;
+	uint32_t max;
+};
+
+/* Summarise 'count' samples, the samples are sorted in place. */
+void stats_calc(uint32_t *samples, int count, struct stats *stats);
+
+#endif /* STATS_H_ */
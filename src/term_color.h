@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef TERM_COLOR_H_
+#define TERM_COLOR_H_
+
+/* ANSI colours of the console output. */
+#define RED	"\e[0;31m"
+#define GREEN	"\e[0;32m"
+#define NORMAL	"\e[0m"
+
+#endif /* TERM_COLOR_H_ */
@@ -9,118 +9,384 @@
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
-#define TWI_MASTER NRF_TWIM1_NS
+#include "bus.h"
+#include "serial_irq.h"
+#include "xfer_timing.h"
+
+/* Batches use instance 1. */
+#define TWI_MASTER twim1.regs
 #define GPIO       NRF_P0_NS
-#define PIN_SCL    2
-#define PIN_SDA    3
 
-extern uint8_t tx_buffer[1024];
-extern uint8_t rx_buffer[2048];
+/* Batched register reads: STOPPED counts the reads in TIMER2 and restarts the next read
+ * through EGU0, whose event can be disabled through a channel group without losing the count.
+ * Once the last read is on the bus its LASTRX disables the restart, its STOPPED reaches
+ * COMPARE[0] and the one interrupt of the batch.
+ */
+#define COUNTER            NRF_TIMER2_NS
+#define RELAY              NRF_EGU0_NS
+#define BATCH_DPPI_LASTRX  0
+#define BATCH_DPPI_RESTART 6
+#define BATCH_DPPI_START   7
+#define BATCH_DPPI_LAST    8
+#define BATCH_GROUP        0
+#define BATCH_LAST_GROUP   1
+#define BATCH_READS        100
+#define BATCH_MAX_SIZE     (sizeof(rx_buffer) / BATCH_READS)
+/* A read of BATCH_MAX_SIZE bytes at 100 kbps ends well within this. */
+#define BATCH_STOP_TIMEOUT_MS 100
+
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
 
 int lp_printf(const char *fmt, ...);
 
-K_SEM_DEFINE(twim_done, 0, 1);
-static bool error = false;
+/* Register addresses of the batch, one byte written per read. */
+static uint8_t batch_regs[BATCH_READS];
+
+struct twim_instance twim1 = {
+	.regs = NRF_TWIM1_NS,
+	.irq = SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn,
+	.pin_scl = 2,
+	.pin_sda = 3,
+	.address = 42,
+	.tx_buffer = tx_buffer,
+	.rx_buffer = rx_buffer,
+};
 
 void twim_isr(const void *arg)
 {
-	if (TWI_MASTER->EVENTS_STOPPED) {
-		TWI_MASTER->EVENTS_STOPPED = 0;
+	struct twim_instance *twim = (struct twim_instance *)arg;
+	NRF_TWIM_Type *regs = twim->regs;
+
+	if (regs->EVENTS_STOPPED) {
+		regs->EVENTS_STOPPED = 0;
 	}
-	if (TWI_MASTER->EVENTS_ERROR) {
-		error = true;
-		TWI_MASTER->EVENTS_ERROR = 0;
+	if (regs->EVENTS_ERROR) {
+		twim->error = true;
+		regs->EVENTS_ERROR = 0;
 	}
-	k_sem_give(&twim_done);
+	k_sem_give(&twim->done);
 }
 
-void twim_init(uint32_t bitrate)
+void twim_instance_init(struct twim_instance *twim, uint32_t bitrate)
 {
+	NRF_TWIM_Type *regs = twim->regs;
+
+	k_sem_init(&twim->done, 0, 1);
+	twim->error = false;
+
 	/* SCK: Dir input, input disconnect, pull up, drive s0d1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SCL] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-				 (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
-				 (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+	GPIO->PIN_CNF[twim->pin_scl] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+				       (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				       (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
 	/* MOSI: Dir input, input disconnect, pull up, drive s0d1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SDA] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-				 (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
-				 (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+	GPIO->PIN_CNF[twim->pin_sda] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+				       (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				       (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
 
 	/* Configure pins. */
-	TWI_MASTER->PSEL.SCL = PIN_SCL;
-	TWI_MASTER->PSEL.SDA = PIN_SDA;
+	regs->PSEL.SCL = twim->pin_scl;
+	regs->PSEL.SDA = twim->pin_sda;
 
 	/* Configure buffers. */
-	TWI_MASTER->RXD.PTR = (int)rx_buffer;
-	TWI_MASTER->TXD.PTR = (int)tx_buffer;
+	regs->RXD.PTR = (int)twim->rx_buffer;
+	regs->TXD.PTR = (int)twim->tx_buffer;
 
 	/* Configure. */
-	TWI_MASTER->FREQUENCY = bitrate;
-	TWI_MASTER->ADDRESS = 42;
+	regs->FREQUENCY = bitrate;
+	regs->ADDRESS = twim->address;
 
 	/* Stop after transfer. */
-	TWI_MASTER->SHORTS = TWIM_SHORTS_LASTTX_STOP_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+	regs->SHORTS = TWIM_SHORTS_LASTTX_STOP_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
 
 	/* Enable interrupt to wake up at the end of a message. */
-	TWI_MASTER->INTENSET = TWIM_INTENSET_STOPPED_Msk | TWIM_INTENSET_ERROR_Msk;
-	irq_connect_dynamic(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, 0, twim_isr, NULL, 0);
-	irq_enable(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn);
+	regs->INTENSET = TWIM_INTENSET_STOPPED_Msk | TWIM_INTENSET_ERROR_Msk;
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	regs->PUBLISH_TXSTARTED = TWIM_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	regs->PUBLISH_RXSTARTED = TWIM_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	regs->PUBLISH_STOPPED = TWIM_PUBLISH_STOPPED_EN_Msk | XFER_TIMING_DPPI_END;
+
+	serial_irq_connect(twim->irq, twim_isr, twim);
+	irq_enable(twim->irq);
 
 	/* Enable. */
-	TWI_MASTER->ENABLE = TWIM_ENABLE_ENABLE_Enabled;
+	regs->ENABLE = TWIM_ENABLE_ENABLE_Enabled;
 
-	lp_printf("    SCL     P0.%02d\n", PIN_SCL);
-	lp_printf("    SDA     P0.%02d\n", PIN_SDA);
+	lp_printf("    SCL     P0.%02d\n", twim->pin_scl);
+	lp_printf("    SDA     P0.%02d\n", twim->pin_sda);
 }
 
-int twim_send(int size)
+void twim_init(uint32_t bitrate)
 {
-	int err = 0;
-
-	error = false;
+	twim_instance_init(&twim1, bitrate);
+}
 
-	TWI_MASTER->TXD.MAXCNT = size;
-	TWI_MASTER->TASKS_STARTTX = 1;
+/* Wait for STOPPED, on an error stop the bus and return the negative ERRORSRC. */
+static int twim_wait(struct twim_instance *twim)
+{
+	int err;
 
-	k_sem_take(&twim_done, K_FOREVER);
+	k_sem_take(&twim->done, K_FOREVER);
 
-	if (error) {
-		err = TWI_MASTER->ERRORSRC;
-		TWI_MASTER->ERRORSRC = err;
-		TWI_MASTER->TASKS_STOP = 1;
-		k_sem_take(&twim_done, K_FOREVER);
+	if (twim->error) {
+		err = twim->regs->ERRORSRC;
+		twim->regs->ERRORSRC = err;
+		twim->regs->TASKS_STOP = 1;
+		k_sem_take(&twim->done, K_FOREVER);
 		return -err;
 	}
 
-	return TWI_MASTER->TXD.AMOUNT;
+	return 0;
+}
+
+/* Write tx_size bytes (e.g. a register address), then read rx_size bytes after a repeated
+ * start, either size can be 0. Returns the number of bytes read, or written without a read,
+ * -EIO if a write before a read was cut short or the negative ERRORSRC.
+ */
+int twim_instance_transfer(struct twim_instance *twim, int tx_size, int rx_size)
+{
+	NRF_TWIM_Type *regs = twim->regs;
+	int err;
+
+	twim->error = false;
+
+	regs->TXD.MAXCNT = tx_size;
+	regs->RXD.MAXCNT = rx_size;
+	if (tx_size && rx_size) {
+		regs->SHORTS = TWIM_SHORTS_LASTTX_STARTRX_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+	}
+	if (tx_size) {
+		regs->TASKS_STARTTX = 1;
+	} else {
+		regs->TASKS_STARTRX = 1;
+	}
+
+	err = twim_wait(twim);
+
+	regs->SHORTS = TWIM_SHORTS_LASTTX_STOP_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+
+	if (err) {
+		return err;
+	}
+	if (!rx_size) {
+		return regs->TXD.AMOUNT;
+	}
+	if (regs->TXD.AMOUNT != tx_size) {
+		return -EIO;
+	}
+
+	return regs->RXD.AMOUNT;
+}
+
+int twim_send(int size)
+{
+	return twim_instance_transfer(&twim1, size, 0);
 }
 
 int twim_recv(int size)
 {
+	return twim_instance_transfer(&twim1, 0, size);
+}
+
+int twim_write_read(int tx_size, int rx_size)
+{
+	return twim_instance_transfer(&twim1, tx_size, rx_size);
+}
+
+/* The STOP of the last read has completed. */
+static void counter_isr(const void *arg)
+{
+	COUNTER->EVENTS_COMPARE[0] = 0;
+	k_sem_give(&twim1.done);
+}
+
+/* Read 'size' bytes from 'reads' consecutive registers with one interrupt at the end.
+ * TXD and RXD use ArrayList so every read writes the next register address and stores its
+ * result after the previous one. Returns the number of completed reads.
+ */
+static int twim_batch(int reads, int size)
+{
+	int64_t deadline;
+	int done;
 	int err = 0;
 
-	error = false;
+	for (int i = 0; i < reads; i++) {
+		batch_regs[i] = i;
+	}
+
+	twim1.error = false;
 
+	TWI_MASTER->TXD.PTR = (int)batch_regs;
+	TWI_MASTER->TXD.MAXCNT = 1;
+	TWI_MASTER->TXD.LIST = TWIM_TXD_LIST_LIST_ArrayList;
+	TWI_MASTER->RXD.PTR = (int)twim1.rx_buffer;
 	TWI_MASTER->RXD.MAXCNT = size;
-	TWI_MASTER->TASKS_STARTRX = 1;
+	TWI_MASTER->RXD.LIST = TWIM_RXD_LIST_LIST_ArrayList;
+	TWI_MASTER->SHORTS = TWIM_SHORTS_LASTTX_STARTRX_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+
+	/* Only the counter interrupts, errors still stop the batch. */
+	TWI_MASTER->INTENCLR = TWIM_INTENCLR_STOPPED_Msk;
+
+	TWI_MASTER->PUBLISH_STOPPED = TWIM_PUBLISH_STOPPED_EN_Msk | BATCH_DPPI_RESTART;
+	TWI_MASTER->SUBSCRIBE_STARTTX = TWIM_SUBSCRIBE_STARTTX_EN_Msk | BATCH_DPPI_START;
+	TWI_MASTER->PUBLISH_LASTRX = TWIM_PUBLISH_LASTRX_EN_Msk | BATCH_DPPI_LASTRX;
+
+	RELAY->EVENTS_TRIGGERED[0] = 0;
+	RELAY->SUBSCRIBE_TRIGGER[0] = EGU_SUBSCRIBE_TRIGGER_EN_Msk | BATCH_DPPI_RESTART;
+	RELAY->PUBLISH_TRIGGERED[0] = EGU_PUBLISH_TRIGGERED_EN_Msk | BATCH_DPPI_START;
 
-	k_sem_take(&twim_done, K_FOREVER);
+	/* CC[0]: all reads stopped, CC[1]: the last read started. */
+	COUNTER->MODE = TIMER_MODE_MODE_LowPowerCounter;
+	COUNTER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	COUNTER->TASKS_CLEAR = 1;
+	COUNTER->CC[0] = reads;
+	COUNTER->CC[1] = reads - 1;
+	COUNTER->EVENTS_COMPARE[0] = 0;
+	COUNTER->SUBSCRIBE_COUNT = TIMER_SUBSCRIBE_COUNT_EN_Msk | BATCH_DPPI_RESTART;
+	COUNTER->PUBLISH_COMPARE[1] = TIMER_PUBLISH_COMPARE_EN_Msk | BATCH_DPPI_LAST;
+	COUNTER->INTENSET = TIMER_INTENSET_COMPARE0_Msk;
+	COUNTER->TASKS_START = 1;
+	irq_connect_dynamic(TIMER2_IRQn, 0, counter_isr, NULL, 0);
+	irq_enable(TIMER2_IRQn);
 
-	if (error) {
-		err = TWI_MASTER->ERRORSRC;
-		TWI_MASTER->ERRORSRC = err;
+	/* The last read arms its LASTRX, which disables the restart before its STOP. */
+	NRF_DPPIC->CHG[BATCH_GROUP] = (1 << BATCH_DPPI_START);
+	NRF_DPPIC->SUBSCRIBE_CHG[BATCH_GROUP].DIS = DPPIC_SUBSCRIBE_CHG_DIS_EN_Msk |
+						    BATCH_DPPI_LASTRX;
+	NRF_DPPIC->CHG[BATCH_LAST_GROUP] = (1 << BATCH_DPPI_LASTRX);
+	NRF_DPPIC->SUBSCRIBE_CHG[BATCH_LAST_GROUP].EN = DPPIC_SUBSCRIBE_CHG_EN_EN_Msk |
+							BATCH_DPPI_LAST;
+	NRF_DPPIC->CHENCLR = (1 << BATCH_DPPI_LASTRX);
+	NRF_DPPIC->CHENSET = (1 << BATCH_DPPI_RESTART) | (1 << BATCH_DPPI_START) |
+			     (1 << BATCH_DPPI_LAST);
+	if (reads == 1) {
+		NRF_DPPIC->TASKS_CHG[BATCH_LAST_GROUP].EN = 1;
+	}
+
+	TWI_MASTER->EVENTS_STOPPED = 0;
+	TWI_MASTER->TASKS_STARTTX = 1;
+
+	if (k_sem_take(&twim1.done, K_SECONDS(10)) || twim1.error) {
+		NRF_DPPIC->CHENCLR = (1 << BATCH_DPPI_RESTART) | (1 << BATCH_DPPI_START);
+		err = twim1.error ? -TWI_MASTER->ERRORSRC : -ETIMEDOUT;
+		TWI_MASTER->ERRORSRC = TWI_MASTER->ERRORSRC;
+		TWI_MASTER->EVENTS_STOPPED = 0;
 		TWI_MASTER->TASKS_STOP = 1;
-		k_sem_take(&twim_done, K_FOREVER);
-		return -err;
+
+		deadline = k_uptime_get() + BATCH_STOP_TIMEOUT_MS;
+		while (!TWI_MASTER->EVENTS_STOPPED && k_uptime_get() <= deadline) {
+		}
 	}
+	TWI_MASTER->EVENTS_STOPPED = 0;
+
+	COUNTER->TASKS_CAPTURE[2] = 1;
+	done = COUNTER->CC[2];
+
+	NRF_DPPIC->CHENCLR = (1 << BATCH_DPPI_LASTRX) | (1 << BATCH_DPPI_RESTART) |
+			     (1 << BATCH_DPPI_START) | (1 << BATCH_DPPI_LAST);
+	NRF_DPPIC->SUBSCRIBE_CHG[BATCH_GROUP].DIS = 0;
+	NRF_DPPIC->SUBSCRIBE_CHG[BATCH_LAST_GROUP].EN = 0;
+	NRF_DPPIC->CHG[BATCH_GROUP] = 0;
+	NRF_DPPIC->CHG[BATCH_LAST_GROUP] = 0;
+
+	RELAY->SUBSCRIBE_TRIGGER[0] = 0;
+	RELAY->PUBLISH_TRIGGERED[0] = 0;
+
+	irq_disable(TIMER2_IRQn);
+	COUNTER->INTENCLR = TIMER_INTENCLR_COMPARE0_Msk;
+	COUNTER->TASKS_STOP = 1;
+	COUNTER->SUBSCRIBE_COUNT = 0;
+	COUNTER->PUBLISH_COMPARE[1] = 0;
+
+	/* Back to single transfers. */
+	TWI_MASTER->PUBLISH_LASTRX = 0;
+	TWI_MASTER->SUBSCRIBE_STARTTX = 0;
+	TWI_MASTER->PUBLISH_STOPPED = TWIM_PUBLISH_STOPPED_EN_Msk | XFER_TIMING_DPPI_END;
+	TWI_MASTER->SHORTS = TWIM_SHORTS_LASTTX_STOP_Msk | TWIM_SHORTS_LASTRX_STOP_Msk;
+	TWI_MASTER->TXD.LIST = 0;
+	TWI_MASTER->RXD.LIST = 0;
+	TWI_MASTER->TXD.PTR = (int)twim1.tx_buffer;
+	TWI_MASTER->RXD.PTR = (int)twim1.rx_buffer;
+	k_sem_reset(&twim1.done);
+	TWI_MASTER->INTENSET = TWIM_INTENSET_STOPPED_Msk;
+
+	return err ? err : done;
+}
+
+static const struct {
+	uint32_t frequency;
+	uint32_t bps;
+} register_frequencies[] = {
+	{TWIM_FREQUENCY_FREQUENCY_K100, 100000},
+	{TWIM_FREQUENCY_FREQUENCY_K250, 250000},
+	{TWIM_FREQUENCY_FREQUENCY_K400, 400000},
+};
+
+/* Register reads of 'size' bytes per second, one by one from the thread and batched. */
+int twim_register_bench(int size)
+{
+	int read_size = CLAMP(size, 1, BATCH_MAX_SIZE);
+	uint32_t frequency = TWI_MASTER->FREQUENCY;
+	int err = 0;
+
+	lp_printf("%d register reads of %d bytes\n", BATCH_READS, read_size);
+
+	for (int i = 0; i < ARRAY_SIZE(register_frequencies); i++) {
+		uint32_t start;
+		uint64_t single_us;
+		uint64_t batch_us;
+		int errors = 0;
+		int done;
+
+		TWI_MASTER->FREQUENCY = register_frequencies[i].frequency;
+
+		start = k_cycle_get_32();
+		for (int read = 0; read < BATCH_READS; read++) {
+			if (twim_write_read(1, read_size) != read_size) {
+				errors++;
+			}
+		}
+		single_us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+		start = k_cycle_get_32();
+		done = twim_batch(BATCH_READS, read_size);
+		batch_us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+
+		if (done < 0) {
+			lp_printf("  %6u bps: batch failed %d\n", register_frequencies[i].bps, done);
+			err = done;
+			break;
+		}
+
+		lp_printf("  %6u bps: single %llu transactions/s (%d errors), "
+			  "batched %llu transactions/s (%d of %d done)\n",
+			  register_frequencies[i].bps,
+			  BATCH_READS * 1000000ULL / MAX(single_us, 1), errors,
+			  done * 1000000ULL / MAX(batch_us, 1), done, BATCH_READS);
+	}
+
+	TWI_MASTER->FREQUENCY = frequency;
+
+	return err;
+}
+
+void twim_instance_deinit(struct twim_instance *twim)
+{
+	NRF_TWIM_Type *regs = twim->regs;
 
-	return TWI_MASTER->RXD.AMOUNT;
+	irq_disable(twim->irq);
+	regs->INTENCLR = TWIM_INTENCLR_STOPPED_Msk | TWIM_INTENCLR_ERROR_Msk;
+	regs->SHORTS = 0;
+	regs->PUBLISH_TXSTARTED = 0;
+	regs->PUBLISH_RXSTARTED = 0;
+	regs->PUBLISH_STOPPED = 0;
+	GPIO->PIN_CNF[twim->pin_scl] = 0;
+	GPIO->PIN_CNF[twim->pin_sda] = 0;
+	regs->ENABLE = 0;
 }
 
 void twim_deinit(void)
 {
-	TWI_MASTER->INTENCLR = TWIM_INTENCLR_STOPPED_Msk| TWIM_INTENCLR_ERROR_Msk;
-	TWI_MASTER->SHORTS = 0;
-	GPIO->PIN_CNF[PIN_SCL] = 0;
-	GPIO->PIN_CNF[PIN_SDA] = 0;
-	TWI_MASTER->ENABLE = 0;
+	twim_instance_deinit(&twim1);
 }
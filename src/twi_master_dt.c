@@ -25,6 +25,11 @@ void init(void)
 	lp_printf("\nUsing TWI Master device: %s\n", p_dev->name);
 	lp_printf("    SCL     P0.%02d\n", TWI_MASTER->PSEL.SCL);
 	lp_printf("    SDA     P0.%02d\n", TWI_MASTER->PSEL.SDA);
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	TWI_MASTER->PUBLISH_TXSTARTED = TWIM_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	TWI_MASTER->PUBLISH_RXSTARTED = TWIM_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	TWI_MASTER->PUBLISH_STOPPED = TWIM_PUBLISH_STOPPED_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 int send(int size)
@@ -41,7 +46,19 @@ int recv(int size)
 	return err ? err : size;
 }
 
-void deinit(void)
+#define HAVE_TRANSCEIVE
+
+/* Register style access, write then read after a repeated start. */
+int transceive(int tx_size, int rx_size)
 {
+	int err = i2c_write_read(p_dev, 42, tx_buffer, tx_size, rx_buffer, rx_size);
 
+	return err ? err : rx_size;
+}
+
+void deinit(void)
+{
+	TWI_MASTER->PUBLISH_TXSTARTED = 0;
+	TWI_MASTER->PUBLISH_RXSTARTED = 0;
+	TWI_MASTER->PUBLISH_STOPPED = 0;
 }
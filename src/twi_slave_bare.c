@@ -9,116 +9,276 @@
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
-#define TWI_SLAVE  NRF_TWIS1_NS
+#include "bus.h"
+#include "serial_irq.h"
+#include "xfer_timing.h"
+
+/* The clock stretch measurement and pre-armed buffers use instance 1. */
+#define TWI_SLAVE  twis1.regs
 #define GPIO       NRF_P0_NS
-#define PIN_SCL    2
-#define PIN_SDA    3
 
-extern uint8_t tx_buffer[1024];
-extern uint8_t rx_buffer[2048];
+/* The master side is started by hand. */
+#define TRANSFER_TIMEOUT K_SECONDS(60)
+
+/* Clock stretch measurement: READ/WRITE start TIMER2, RXSTARTED/TXSTARTED capture and stop it.
+ * When suspending on READ/WRITE the timer only runs while SCL is held low. Pre-armed, nothing
+ * suspends the bus and the time is only the address match to DMA start latency.
+ */
+#define STRETCH_TIMER        NRF_TIMER2_NS
+#define STRETCH_TIMER_MHZ    16
+#define ADDR_DPPI_CHANNEL    9
+#define STARTED_DPPI_CHANNEL 10
+
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
 
 int lp_printf(const char *fmt, ...);
 
-K_SEM_DEFINE(twis_done, 0, 1);
+struct twis_instance twis1 = {
+	.regs = NRF_TWIS1_NS,
+	.irq = SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn,
+	.pin_scl = 2,
+	.pin_sda = 3,
+	.address = 42,
+	.tx_buffer = tx_buffer,
+	.rx_buffer = rx_buffer,
+};
+
+/* Clock stretch per transaction in timer ticks. */
+static uint32_t stretch_current;
+static uint32_t stretch_count;
+static uint64_t stretch_sum;
+static uint32_t stretch_max;
 
 void twis_isr(const void *arg)
 {
-	if (TWI_SLAVE->EVENTS_STOPPED) {
-		k_sem_give(&twis_done);
-		TWI_SLAVE->EVENTS_STOPPED = 0;
+	struct twis_instance *twis = (struct twis_instance *)arg;
+	NRF_TWIS_Type *regs = twis->regs;
+	/* The stretch timer only measures instance 1. */
+	bool stretch = twis == &twis1;
+
+	if (regs->EVENTS_RXSTARTED || regs->EVENTS_TXSTARTED) {
+		if (regs->EVENTS_RXSTARTED) {
+			regs->EVENTS_RXSTARTED = 0;
+			twis->started |= TWIS_STARTED_RX;
+		}
+		if (regs->EVENTS_TXSTARTED) {
+			regs->EVENTS_TXSTARTED = 0;
+			twis->started |= TWIS_STARTED_TX;
+		}
+		/* A write-read stretches twice, before the write and before the read. */
+		if (stretch) {
+			stretch_current += STRETCH_TIMER->CC[0];
+		}
 	}
-	if (TWI_SLAVE->EVENTS_READ) {
-		TWI_SLAVE->TASKS_PREPARETX = 1;
-		TWI_SLAVE->TASKS_RESUME = 1;
-		TWI_SLAVE->EVENTS_READ = 0;
+	if (regs->EVENTS_STOPPED) {
+		if (stretch) {
+			stretch_count++;
+			stretch_sum += stretch_current;
+			stretch_max = MAX(stretch_max, stretch_current);
+			stretch_current = 0;
+		}
+
+		k_sem_give(&twis->done);
+		regs->EVENTS_STOPPED = 0;
+	}
+	if (regs->EVENTS_READ) {
+		regs->TASKS_PREPARETX = 1;
+		regs->TASKS_RESUME = 1;
+		regs->EVENTS_READ = 0;
 	}
-	if (TWI_SLAVE->EVENTS_WRITE) {
-		TWI_SLAVE->TASKS_PREPARERX = 1;
-		TWI_SLAVE->TASKS_RESUME = 1;
-		TWI_SLAVE->EVENTS_WRITE = 0;
+	if (regs->EVENTS_WRITE) {
+		regs->TASKS_PREPARERX = 1;
+		regs->TASKS_RESUME = 1;
+		regs->EVENTS_WRITE = 0;
 	}
 }
 
-void twis_init(uint32_t bitrate)
+void twis_instance_init(struct twis_instance *twis, uint32_t bitrate)
 {
+	NRF_TWIS_Type *regs = twis->regs;
+
+	k_sem_init(&twis->done, 0, 1);
+	twis->prearmed = false;
+	twis->started = 0;
+
 	/* SCK: Dir output, input disconnect, pull up, drive h0d1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SCL] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-				 (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
-				 (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+	GPIO->PIN_CNF[twis->pin_scl] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+				       (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				       (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
 	/* MOSI: Dir output, input disconnect, pull up, drive h0d1, sense disabled. */
-	GPIO->PIN_CNF[PIN_SDA] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
-				 (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
-				 (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
+	GPIO->PIN_CNF[twis->pin_sda] = (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos) |
+				       (GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos) |
+				       (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos);
 
 	/* Configure pins. */
-	TWI_SLAVE->PSEL.SCL = PIN_SCL;
-	TWI_SLAVE->PSEL.SDA = PIN_SDA;
+	regs->PSEL.SCL = twis->pin_scl;
+	regs->PSEL.SDA = twis->pin_sda;
 
 	/* Configure buffers. */
-	TWI_SLAVE->RXD.PTR = (int)rx_buffer;
-	TWI_SLAVE->RXD.MAXCNT = 0;
-	TWI_SLAVE->TXD.PTR = (int)tx_buffer;
-	TWI_SLAVE->TXD.MAXCNT = 0;
+	regs->RXD.PTR = (int)twis->rx_buffer;
+	regs->RXD.MAXCNT = 0;
+	regs->TXD.PTR = (int)twis->tx_buffer;
+	regs->TXD.MAXCNT = 0;
 
 	/* Configure. */
-	TWI_SLAVE->ADDRESS[0] = 42;
-	TWI_SLAVE->CONFIG = TWIS_CONFIG_ADDRESS0_Msk;
+	regs->ADDRESS[0] = twis->address;
+	regs->CONFIG = TWIS_CONFIG_ADDRESS0_Msk;
 	/* Suspend after we have received a READ or WRITE flag so we can either start RX or TX. */
-	TWI_SLAVE->SHORTS = TWIS_SHORTS_READ_SUSPEND_Msk | TWIS_SHORTS_WRITE_SUSPEND_Msk;
+	regs->SHORTS = TWIS_SHORTS_READ_SUSPEND_Msk | TWIS_SHORTS_WRITE_SUSPEND_Msk;
 
 	/* Enable interrupt to wake up at the end of a message. */
-	TWI_SLAVE->INTENSET = TWIS_INTENSET_STOPPED_Msk | TWIS_INTENSET_READ_Msk |
-			      TWIS_INTENSET_WRITE_Msk;
-	irq_connect_dynamic(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, 0, twis_isr, NULL, 0);
-	irq_enable(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn);
+	regs->INTENSET = TWIS_INTENSET_STOPPED_Msk | TWIS_INTENSET_READ_Msk |
+			 TWIS_INTENSET_WRITE_Msk | TWIS_INTENSET_RXSTARTED_Msk |
+			 TWIS_INTENSET_TXSTARTED_Msk;
+
+	/* Publish end of a transfer for the timing measurement. */
+	regs->PUBLISH_STOPPED = TWIS_PUBLISH_STOPPED_EN_Msk | XFER_TIMING_DPPI_END;
+
+	serial_irq_connect(twis->irq, twis_isr, twis);
+	irq_enable(twis->irq);
 
 	/* Enable. */
-	TWI_SLAVE->ENABLE = TWIS_ENABLE_ENABLE_Enabled;
+	regs->ENABLE = TWIS_ENABLE_ENABLE_Enabled;
 
-	lp_printf("    SCL     P0.%02d\n", PIN_SCL);
-	lp_printf("    SDA     P0.%02d\n", PIN_SDA);
+	lp_printf("    SCL     P0.%02d\n", twis->pin_scl);
+	lp_printf("    SDA     P0.%02d\n", twis->pin_sda);
 }
 
-int twis_send(int size)
+void twis_init(uint32_t bitrate)
 {
-	TWI_SLAVE->TXD.MAXCNT = size;
+	twis_instance_init(&twis1, bitrate);
 
-	if (k_sem_take(&twis_done,  K_SECONDS(60))) {
-		return -ETIMEDOUT;
-	}
+	/* Time from address match (READ/WRITE) to the DMA start, SCL is held low meanwhile. The
+	 * start events measure this instead of the transfer timing, so the timing counts the
+	 * stretch as wire time.
+	 */
+	STRETCH_TIMER->MODE = TIMER_MODE_MODE_Timer;
+	STRETCH_TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	STRETCH_TIMER->PRESCALER = 0;
+	TWI_SLAVE->PUBLISH_READ = TWIS_PUBLISH_READ_EN_Msk | ADDR_DPPI_CHANNEL;
+	TWI_SLAVE->PUBLISH_WRITE = TWIS_PUBLISH_WRITE_EN_Msk | ADDR_DPPI_CHANNEL;
+	TWI_SLAVE->PUBLISH_RXSTARTED = TWIS_PUBLISH_RXSTARTED_EN_Msk | STARTED_DPPI_CHANNEL;
+	TWI_SLAVE->PUBLISH_TXSTARTED = TWIS_PUBLISH_TXSTARTED_EN_Msk | STARTED_DPPI_CHANNEL;
+	STRETCH_TIMER->SUBSCRIBE_CLEAR = TIMER_SUBSCRIBE_CLEAR_EN_Msk | ADDR_DPPI_CHANNEL;
+	STRETCH_TIMER->SUBSCRIBE_START = TIMER_SUBSCRIBE_START_EN_Msk | ADDR_DPPI_CHANNEL;
+	STRETCH_TIMER->SUBSCRIBE_CAPTURE[0] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | STARTED_DPPI_CHANNEL;
+	STRETCH_TIMER->SUBSCRIBE_STOP = TIMER_SUBSCRIBE_STOP_EN_Msk | STARTED_DPPI_CHANNEL;
+	NRF_DPPIC->CHENSET = (1 << ADDR_DPPI_CHANNEL) | (1 << STARTED_DPPI_CHANNEL);
 
-	if (!TWI_SLAVE->EVENTS_TXSTARTED) {
-		return -EBADR;	/* Got RX instead of TX. */
-	}
+	stretch_current = 0;
+	stretch_count = 0;
+	stretch_sum = 0;
+	stretch_max = 0;
+}
 
-	TWI_SLAVE->EVENTS_TXSTARTED = 0;
+/* Answer without clock stretching for the interrupt: no READ/WRITE suspend, both buffers are
+ * prepared up front and STOPPED prepares them again through DPPI. STOPPED is published on the
+ * timing END channel, listed in xfer_timing.h.
+ */
+void twis_prearmed_init(uint32_t bitrate)
+{
+	twis_init(bitrate);
 
-	return TWI_SLAVE->TXD.AMOUNT;
+	TWI_SLAVE->SHORTS = 0;
+	TWI_SLAVE->INTENCLR = TWIS_INTENCLR_READ_Msk | TWIS_INTENCLR_WRITE_Msk;
+	TWI_SLAVE->SUBSCRIBE_PREPARERX = TWIS_SUBSCRIBE_PREPARERX_EN_Msk | XFER_TIMING_DPPI_END;
+	TWI_SLAVE->SUBSCRIBE_PREPARETX = TWIS_SUBSCRIBE_PREPARETX_EN_Msk | XFER_TIMING_DPPI_END;
+	twis1.prearmed = true;
 }
 
-int twis_recv(int size)
+/* Arm the buffers and wait for the master to end a transaction in the directions that have a
+ * size. Returns the number of bytes received, or sent without a receive, -EBADR if an armed
+ * direction didn't start and -EIO if the master read fewer than tx_size bytes.
+ */
+int twis_instance_transfer(struct twis_instance *twis, int tx_size, int rx_size,
+			   k_timeout_t timeout)
 {
-	TWI_SLAVE->RXD.MAXCNT = size;
+	NRF_TWIS_Type *regs = twis->regs;
+	uint32_t expected = (tx_size ? TWIS_STARTED_TX : 0) | (rx_size ? TWIS_STARTED_RX : 0);
 
-	if (k_sem_take(&twis_done,  K_SECONDS(60))) {
+	twis->started = 0;
+	regs->TXD.MAXCNT = tx_size;
+	regs->RXD.MAXCNT = rx_size;
+
+	if (twis->prearmed) {
+		regs->TASKS_PREPARERX = 1;
+		regs->TASKS_PREPARETX = 1;
+	}
+
+	if (k_sem_take(&twis->done, timeout)) {
 		return -ETIMEDOUT;
 	}
 
-	if (!TWI_SLAVE->EVENTS_RXSTARTED) {
-		return -EBADR;	/* Got TX instead of RX. */
+	if ((twis->started & expected) != expected) {
+		return -EBADR;	/* A direction that was armed didn't start. */
 	}
+	if (!rx_size) {
+		return regs->TXD.AMOUNT;
+	}
+	if (tx_size && regs->TXD.AMOUNT != tx_size) {
+		return -EIO;
+	}
+
+	return regs->RXD.AMOUNT;
+}
+
+int twis_send(int size)
+{
+	return twis_instance_transfer(&twis1, size, 0, TRANSFER_TIMEOUT);
+}
+
+int twis_recv(int size)
+{
+	return twis_instance_transfer(&twis1, 0, size, TRANSFER_TIMEOUT);
+}
+
+/* Answer a write followed by a read (repeated start). The buffers stay armed afterwards so
+ * the slave keeps serving register reads while the master benchmarks them.
+ */
+int twis_transceive(int tx_size, int rx_size)
+{
+	return twis_instance_transfer(&twis1, tx_size, rx_size, TRANSFER_TIMEOUT);
+}
 
-	TWI_SLAVE->EVENTS_RXSTARTED = 0;
+void twis_instance_deinit(struct twis_instance *twis)
+{
+	NRF_TWIS_Type *regs = twis->regs;
 
-	return TWI_SLAVE->RXD.AMOUNT;
+	irq_disable(twis->irq);
+	regs->INTENCLR = TWIS_INTENCLR_STOPPED_Msk | TWIS_INTENCLR_READ_Msk |
+			 TWIS_INTENCLR_WRITE_Msk | TWIS_INTENCLR_RXSTARTED_Msk |
+			 TWIS_INTENCLR_TXSTARTED_Msk;
+	regs->SHORTS = 0;
+	regs->SUBSCRIBE_PREPARERX = 0;
+	regs->SUBSCRIBE_PREPARETX = 0;
+	regs->PUBLISH_TXSTARTED = 0;
+	regs->PUBLISH_RXSTARTED = 0;
+	regs->PUBLISH_STOPPED = 0;
+	regs->PUBLISH_READ = 0;
+	regs->PUBLISH_WRITE = 0;
+	GPIO->PIN_CNF[twis->pin_scl] = 0;
+	GPIO->PIN_CNF[twis->pin_sda] = 0;
+	regs->ENABLE = 0;
 }
 
 void twis_deinit(void)
 {
-	TWI_SLAVE->INTENCLR = TWIS_INTENCLR_STOPPED_Msk | TWIS_INTENCLR_READ_Msk |
-			      TWIS_INTENCLR_WRITE_Msk;
-	TWI_SLAVE->SHORTS = 0;
-	GPIO->PIN_CNF[PIN_SCL] = 0;
-	GPIO->PIN_CNF[PIN_SDA] = 0;
-	TWI_SLAVE->ENABLE = 0;
+	if (stretch_count) {
+		lp_printf("%s: %s %llu ns per transaction on average, %u ns max, "
+			  "%u transactions\n",
+			  twis1.prearmed ? "Pre-armed" : "Suspend on READ/WRITE",
+			  twis1.prearmed ? "address match to DMA start" : "SCL held low",
+			  stretch_sum * 1000 / STRETCH_TIMER_MHZ / stretch_count,
+			  stretch_max * 1000 / STRETCH_TIMER_MHZ, stretch_count);
+	}
+
+	NRF_DPPIC->CHENCLR = (1 << ADDR_DPPI_CHANNEL) | (1 << STARTED_DPPI_CHANNEL);
+	STRETCH_TIMER->TASKS_STOP = 1;
+	STRETCH_TIMER->SUBSCRIBE_CLEAR = 0;
+	STRETCH_TIMER->SUBSCRIBE_START = 0;
+	STRETCH_TIMER->SUBSCRIBE_CAPTURE[0] = 0;
+	STRETCH_TIMER->SUBSCRIBE_STOP = 0;
+
+	twis_instance_deinit(&twis1);
 }
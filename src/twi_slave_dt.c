@@ -62,6 +62,11 @@ void init(void)
 	lp_printf("\nUsing TWI Slave device: %s\n", p_dev->name);
 	lp_printf("    SCL     P0.%02d\n", TWI_SLAVE->PSEL.SCL);
 	lp_printf("    SDA     P0.%02d\n", TWI_SLAVE->PSEL.SDA);
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	TWI_SLAVE->PUBLISH_TXSTARTED = TWIS_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	TWI_SLAVE->PUBLISH_RXSTARTED = TWIS_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	TWI_SLAVE->PUBLISH_STOPPED = TWIS_PUBLISH_STOPPED_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 int send(int size)
@@ -84,5 +89,7 @@ int recv(int size)
 
 void deinit(void)
 {
-
+	TWI_SLAVE->PUBLISH_TXSTARTED = 0;
+	TWI_SLAVE->PUBLISH_RXSTARTED = 0;
+	TWI_SLAVE->PUBLISH_STOPPED = 0;
 }
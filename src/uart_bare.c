@@ -6,84 +6,169 @@
  */
 
 #include <stdio.h>
+#include <string.h>
 #include <unistd.h>
 #include <zephyr/kernel.h>
 
-#define UART    NRF_UARTE1_NS
+#include "bus.h"
+#include "serial_irq.h"
+#include "stats.h"
+#include "term_color.h"
+#include "xfer_timing.h"
+
+/* The timeout, low power, ring and streaming tests only run on instance 1. */
+#define UART    uarte1.regs
 #define TIMER   NRF_TIMER0_NS
+#define COUNTER NRF_TIMER2_NS
 #define GPIO    NRF_P0_NS
 #define GPIOTE  NRF_GPIOTE1_NS
 #define REQ_DPPI_CHANNEL 1
 #define REQ_GPIOTE_NR 0
 #define RDY_DPPI_CHANNEL 2
 #define RDY_GPIOTE_NR 1
-#define PIN_TXD 6
-#define PIN_RXD 7
+#define RING_DPPI_CHANNEL 3
 #define PIN_REQ 2
 #define PIN_RDY 3
 
-extern uint8_t tx_buffer[1024];
-extern uint8_t rx_buffer[2048];
+/* Continuous RX chains this many DMA chunks through rx_buffer. */
+#define RING_CHUNKS     4
+#define RING_SIZE       sizeof(rx_buffer)
+#define RING_CHUNK_SIZE (RING_SIZE / RING_CHUNKS)
+
+/* Streaming TX runs this long. */
+#define STREAM_SECONDS  2
+
+extern uint8_t tx_buffer[8 * 1024];
+extern uint8_t rx_buffer[8 * 1024];
 
 int lp_printf(const char *fmt, ...);
 
-K_SEM_DEFINE(uart_done, 0, 1);
+struct uarte_instance uarte1 = {
+	.regs = NRF_UARTE1_NS,
+	.irq = SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn,
+	.pin_txd = 6,
+	.pin_rxd = 7,
+	.tx_buffer = tx_buffer,
+	.rx_buffer = rx_buffer,
+};
+
+K_SEM_DEFINE(ring_data, 0, 1);
+
+static bool ring_active;
+static int ring_chunk;
+static uint32_t ring_read;
+static uint32_t ring_lost;
+
+static void uart_ring_isr(void)
+{
+	if (UART->EVENTS_RXSTARTED) {
+		UART->EVENTS_RXSTARTED = 0;
+
+		/* The chunk that just started is latched, ENDRX_STARTRX will continue in the next. */
+		ring_chunk = (ring_chunk + 1) % RING_CHUNKS;
+		UART->RXD.PTR = (int)&rx_buffer[ring_chunk * RING_CHUNK_SIZE];
+
+		k_sem_give(&ring_data);
+	}
+
+	/* Not enabled as interrupt but set at every chunk boundary. */
+	UART->EVENTS_ENDRX = 0;
+}
 
 void uart_isr(const void *arg)
 {
-	if (UART->EVENTS_ENDRX) {
-		UART->EVENTS_ENDRX = 0;
+	struct uarte_instance *uarte = (struct uarte_instance *)arg;
+	NRF_UARTE_Type *regs = uarte->regs;
+
+	if (ring_active) {
+		uart_ring_isr();
+		return;
 	}
-	if (UART->EVENTS_ENDTX) {
-		UART->EVENTS_ENDTX = 0;
+
+	if (regs->EVENTS_ENDRX) {
+		regs->EVENTS_ENDRX = 0;
+	}
+	if (regs->EVENTS_ENDTX) {
+		regs->EVENTS_ENDTX = 0;
+
+		if (uarte->repeat) {
+			uarte->bytes += regs->TXD.AMOUNT;
+			regs->TASKS_STARTTX = 1;
+			return;
+		}
 	}
-	k_sem_give(&uart_done);
+	k_sem_give(&uarte->done);
 }
 
-void uart_init(uint32_t bitrate)
+void uart_instance_init(struct uarte_instance *uarte, uint32_t bitrate)
 {
+	NRF_UARTE_Type *regs = uarte->regs;
+
+	k_sem_init(&uarte->done, 0, 1);
+	uarte->repeat = false;
+
 	/* Dir input, input connect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_RXD] = 0;
+	GPIO->PIN_CNF[uarte->pin_rxd] = 0;
 
 	/* Select pins. */
-	UART->PSEL.TXD = PIN_TXD;
-	UART->PSEL.RXD = PIN_RXD;
+	regs->PSEL.TXD = uarte->pin_txd;
+	regs->PSEL.RXD = uarte->pin_rxd;
 
 	/* Configure buffers. */
-	UART->RXD.PTR = (int)rx_buffer;
-	UART->RXD.MAXCNT = sizeof(rx_buffer);
-	UART->TXD.PTR = (int)tx_buffer;
-	UART->TXD.MAXCNT = sizeof(tx_buffer);
+	regs->RXD.PTR = (int)uarte->rx_buffer;
+	regs->RXD.MAXCNT = sizeof(rx_buffer);
+	regs->TXD.PTR = (int)uarte->tx_buffer;
+	regs->TXD.MAXCNT = sizeof(tx_buffer);
 
 	/* Baudrate 1M. */
-	UART->BAUDRATE = bitrate;
+	regs->BAUDRATE = bitrate;
 
 	/* HW flow control disabled, Parity N, Stopbits 1. */
-	UART->CONFIG = 0;
+	regs->CONFIG = 0;
 
 
 	/* Enable interrupt to wake up at the end of a message. */
-	UART->INTENSET = UARTE_INTENSET_ENDRX_Msk | UARTE_INTENSET_ENDTX_Msk;
-	irq_connect_dynamic(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn, 0, uart_isr, NULL, 0);
-	irq_enable(SPIM1_SPIS1_TWIM1_TWIS1_UARTE1_IRQn);
+	regs->INTENSET = UARTE_INTENSET_ENDRX_Msk | UARTE_INTENSET_ENDTX_Msk;
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	regs->PUBLISH_TXSTARTED = UARTE_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	regs->PUBLISH_RXSTARTED = UARTE_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	regs->PUBLISH_ENDTX = UARTE_PUBLISH_ENDTX_EN_Msk | XFER_TIMING_DPPI_END;
+	regs->PUBLISH_ENDRX = UARTE_PUBLISH_ENDRX_EN_Msk | XFER_TIMING_DPPI_END;
+
+	serial_irq_connect(uarte->irq, uart_isr, uarte);
+	irq_enable(uarte->irq);
 
 	/* Enable. */
-	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+	regs->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
 
 	/* Dir output, input disconnect, pull disabled, drive s0s1, sense disabled. */
-	GPIO->PIN_CNF[PIN_TXD] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
+	GPIO->PIN_CNF[uarte->pin_txd] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
 				 (GPIO_PIN_CNF_INPUT_Disconnect << GPIO_PIN_CNF_INPUT_Pos);
 
-	lp_printf("    TXD     P0.%02d\n", PIN_TXD);
-	lp_printf("    RXD     P0.%02d\n", PIN_RXD);
+	lp_printf("    TXD     P0.%02d\n", uarte->pin_txd);
+	lp_printf("    RXD     P0.%02d\n", uarte->pin_rxd);
 }
 
-void uart_timeout_init(uint32_t bitrate)
+void uart_init(uint32_t bitrate)
+{
+	uart_instance_init(&uarte1, bitrate);
+}
+
+/* TIMER1 channels of the end-of-frame timestamps. */
+#define CC_LAST_BYTE 4
+#define CC_TIMEOUT   5
+
+/* Stop receive when no byte has been received for 'ticks' of TIMER at 2^prescaler / 16 MHz. */
+static void uart_timeout_setup(uint32_t bitrate, uint32_t prescaler, uint32_t ticks)
 {
 	uart_init(bitrate);
 
 	/* Set a timer to stop receive before the buffer is full if no more bytes are received. */
-	TIMER->CC[0] = 1000;	/* 1 ms */
+	TIMER->MODE = TIMER_MODE_MODE_Timer;
+	TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	TIMER->PRESCALER = prescaler;
+	TIMER->CC[0] = ticks;
 	TIMER->SHORTS = TIMER_SHORTS_COMPARE0_STOP_Msk;
 
 	/* Start and clear a timer when a byte is received using channel 1.  */
@@ -96,15 +181,60 @@ void uart_timeout_init(uint32_t bitrate)
 	TIMER->PUBLISH_COMPARE[0] = TIMER_PUBLISH_COMPARE_EN_Msk | 2;
 	UART->SUBSCRIBE_STOPRX = UARTE_SUBSCRIBE_STOPRX_EN_Msk | 2;
 	NRF_DPPIC->CHENSET = (1 << 2);
+
+	/* Timestamp the last byte and the timeout on the transfer timing timer. */
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_LAST_BYTE] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | 1;
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_TIMEOUT] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | 2;
 }
 
-void uart_lp_init(uint32_t bitrate)
+void uart_timeout_init(uint32_t bitrate)
 {
-	uart_init(bitrate);
+	/* 1 MHz, 1 ms. */
+	uart_timeout_setup(bitrate, 4, 1000);
+}
 
-	/* Disable UART completely while not using it to save power. */
-	UART->ENABLE = 0;
+/* A character is 10 bits (start, 8 data, stop). The UARTE divides 16 MHz by
+ * 2^32 / BAUDRATE, so at 16 MHz a bit lasts 2^32 / BAUDRATE timer ticks.
+ */
+void uart_timeout_chars_init(uint32_t bitrate)
+{
+	uint32_t ticks = ((uint64_t)CONFIG_UART_RX_TIMEOUT_CHARS * 10 << 32) / bitrate;
+
+	uart_timeout_setup(bitrate, 0, ticks);
+
+	lp_printf("    RX timeout %d characters, %u us\n", CONFIG_UART_RX_TIMEOUT_CHARS,
+		  ticks / 16);
+}
+
+/* Receive a frame of up to 'size' bytes ended by the idle timeout. Returns its length and
+ * stores when its last byte arrived, in µs of the transfer timing timer.
+ */
+int uart_recv_frame(int size, uint32_t *end_us)
+{
+	int ret = uart_instance_recv(&uarte1, size, K_SECONDS(60));
+
+	if (ret > 0) {
+		*end_us = XFER_TIMING_TIMER->CC[CC_LAST_BYTE];
+	}
+
+	return ret;
+}
 
+int uart_timeout_recv(int size)
+{
+	uint32_t end_us;
+	int ret = uart_recv_frame(size, &end_us);
+
+	if (ret > 0) {
+		lp_printf("Frame of %d bytes ended at %u us, receive stopped %u us later\n", ret,
+			  end_us, XFER_TIMING_TIMER->CC[CC_TIMEOUT] - end_us);
+	}
+
+	return ret;
+}
+
+static void uart_lp_pins_init(void)
+{
 	/* Output low, connect input, pull disabled, standard 0, standard 1, no sense. */
 	GPIO->OUTCLR = 1 << PIN_REQ;
 	GPIO->PIN_CNF[PIN_REQ] = GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos;
@@ -114,20 +244,56 @@ void uart_lp_init(uint32_t bitrate)
 	GPIO->PIN_CNF[PIN_RDY] = (GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos) |
 				 (GPIO_PIN_CNF_DRIVE_S0D1 << GPIO_PIN_CNF_DRIVE_Pos) |
 				 (GPIO_PIN_CNF_SENSE_High << GPIO_PIN_CNF_SENSE_Pos);
+}
+
+void uart_lp_init(uint32_t bitrate)
+{
+	uart_init(bitrate);
+
+	/* Disable UART completely while not using it to save power. */
+	UART->ENABLE = 0;
+
+	uart_lp_pins_init();
 
 	lp_printf("    REQ     P0.%02d\n", PIN_REQ);
 	lp_printf("    RDY     P0.%02d\n", PIN_RDY);
 }
 
+int uart_instance_send(struct uarte_instance *uarte, int size)
+{
+	uarte->regs->TXD.MAXCNT = size;
+	uarte->regs->TASKS_STARTTX = 1;
+
+	k_sem_take(&uarte->done, K_FOREVER);
+
+	uarte->regs->TASKS_STOPTX = 1;
+	return uarte->regs->TXD.AMOUNT;
+}
+
 int uart_send(size_t size)
 {
-	UART->TXD.MAXCNT = size;
-	UART->TASKS_STARTTX = 1;
+	return uart_instance_send(&uarte1, size);
+}
 
-	k_sem_take(&uart_done, K_FOREVER);
+/* The interrupt starts the next transfer as soon as one has ended. */
+void uart_repeat_start(struct uarte_instance *uarte, int size)
+{
+	uarte->bytes = 0;
+	uarte->repeat = true;
+	uarte->regs->TXD.MAXCNT = size;
+	uarte->regs->TASKS_STARTTX = 1;
+}
 
-	UART->TASKS_STOPTX = 1;
-	return UART->TXD.AMOUNT;
+uint64_t uart_repeat_stop(struct uarte_instance *uarte)
+{
+	/* The transfer on the wire ends normally. */
+	uarte->repeat = false;
+	if (!k_sem_take(&uarte->done, K_SECONDS(1))) {
+		uarte->bytes += uarte->regs->TXD.AMOUNT;
+	}
+	uarte->regs->TASKS_STOPTX = 1;
+
+	return uarte->bytes;
 }
 
 int uart_lp_send(size_t size)
@@ -149,7 +315,7 @@ int uart_lp_send(size_t size)
 	GPIO->PIN_CNF[PIN_REQ] = GPIO_PIN_CNF_PULL_Pullup << GPIO_PIN_CNF_PULL_Pos;
 
 	/* Wait for TX done. */
-	k_sem_take(&uart_done, K_FOREVER);
+	k_sem_take(&uarte1.done, K_FOREVER);
 
 	UART->TASKS_STOPTX = 1;
 
@@ -171,20 +337,36 @@ int uart_lp_send(size_t size)
 	return UART->TXD.AMOUNT;
 }
 
-int uart_recv(int size)
+int uart_instance_recv(struct uarte_instance *uarte, int size, k_timeout_t timeout)
 {
-	UART->RXD.MAXCNT = size;
-	UART->TASKS_STARTRX = 1;
+	uarte->regs->RXD.MAXCNT = size;
+	uarte->regs->TASKS_STARTRX = 1;
+
+	if (k_sem_take(&uarte->done, timeout)) {
+		/* Stopping RX ends with ENDRX. */
+		uarte->regs->TASKS_STOPRX = 1;
+		k_sem_take(&uarte->done, K_FOREVER);
+		return -ETIMEDOUT;
+	}
 
-	k_sem_take(&uart_done, K_FOREVER);
+	return uarte->regs->RXD.AMOUNT;
+}
 
-	return UART->RXD.AMOUNT;
+int uart_recv(int size)
+{
+	return uart_instance_recv(&uarte1, size, K_SECONDS(60));
 }
 
+/* TIMER1 captures of the low power modes, the wake-up and the first byte on the wire. */
+#define CC_WAKE       4
+#define CC_FIRST_BYTE 5
+
 void pin_isr(const void *arg)
 {
 	__NOP();
 
+	XFER_TIMING_TIMER->TASKS_CAPTURE[CC_WAKE] = 1;
+
 	/* Enable UART andd RX. */
 	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
 	UART->TASKS_STARTRX = 1;
@@ -229,7 +411,7 @@ int uart_lp_recv(int size)
 	irq_enable(GPIOTE1_IRQn);
 
 	/* Wait for RX to finish. */
-	k_sem_take(&uart_done, K_FOREVER);
+	k_sem_take(&uarte1.done, K_FOREVER);
 
 	/* Disable interrupt on RDY pin in two steps to prevent 23 µA current leak. */
 	GPIOTE->CONFIG[RDY_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Disabled |
@@ -245,15 +427,572 @@ int uart_lp_recv(int size)
 	return UART->RXD.AMOUNT;
 }
 
-void uart_deinit(void)
+/* Session mode: either side wakes the link and both send several frames before it sleeps
+ * again. Each side drives its own REQ and watches the REQ of the peer on RDY, so two wires
+ * cross P0.02 and P0.03 of the boards. Raising REQ asks for a session and acknowledges one at
+ * the same time, when both sides ask together the session simply opens. A side lowers REQ
+ * after its last frame, the falling RDY stops RX of the peer through DPPI channel 2. The UARTE
+ * is only enabled from the wake-up until both sides are done.
+ */
+#define SESSION_WAKEUPS   20
+#define SESSION_GAP_MS    20
+#define SESSION_LATENCIES 256
+#define SESSION_TIMEOUT   K_SECONDS(10)
+/* RXD.MAXCNT has 13 bits, one byte less than rx_buffer. */
+#define SESSION_RX_MAX    (sizeof(rx_buffer) - 1)
+
+/* Input with pull-down for a peer that isn't powered, sense high while the link sleeps. */
+#define RDY_CNF       (GPIO_PIN_CNF_PULL_Pulldown << GPIO_PIN_CNF_PULL_Pos)
+#define RDY_SENSE_CNF (RDY_CNF | (GPIO_PIN_CNF_SENSE_High << GPIO_PIN_CNF_SENSE_Pos))
+
+enum session_state {
+	SESSION_IDLE,
+	SESSION_REQUESTED,
+	SESSION_OPEN,
+};
+
+/* The CPU and UARTE awake time stand in for the energy, both dominate the current. */
+struct session_stats {
+	uint32_t wakeups;
+	uint32_t sent;
+	uint32_t received;
+	uint32_t uart_on_us;
+	uint64_t cpu_cycles;
+	uint32_t latency_us[SESSION_LATENCIES];
+	int latencies;
+};
+
+K_SEM_DEFINE(session_opened, 0, 1);
+K_SEM_DEFINE(session_tx, 0, 1);
+K_SEM_DEFINE(session_rx, 0, 1);
+
+static volatile enum session_state session_state;
+static int session_size;
+static int session_frames;
+
+static void session_uart_isr(const void *arg)
 {
-	GPIO->PIN_CNF[PIN_TXD] = 0;
-	UART->INTENCLR = UARTE_INTENCLR_ENDRX_Msk | UARTE_INTENCLR_ENDTX_Msk;
+	if (UART->EVENTS_ENDTX) {
+		UART->EVENTS_ENDTX = 0;
+		k_sem_give(&session_tx);
+	}
+	if (UART->EVENTS_ENDRX) {
+		UART->EVENTS_ENDRX = 0;
+		k_sem_give(&session_rx);
+	}
+}
+
+/* Enable the UARTE and receive until the peer lowers its REQ. */
+static void session_enable(void)
+{
+	/* Link RDY pin high to low to STOPRX using channel 2. */
+	GPIOTE->CONFIG[RDY_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Event |
+				      (PIN_RDY << GPIOTE_CONFIG_PSEL_Pos) |
+				      (GPIOTE_CONFIG_POLARITY_HiToLo << GPIOTE_CONFIG_POLARITY_Pos);
+	GPIOTE->PUBLISH_IN[RDY_GPIOTE_NR] = GPIOTE_PUBLISH_IN_EN_Msk | RDY_DPPI_CHANNEL;
+	UART->SUBSCRIBE_STOPRX = UARTE_SUBSCRIBE_STOPRX_EN_Msk | RDY_DPPI_CHANNEL;
+	NRF_DPPIC->CHENSET = (1 << RDY_DPPI_CHANNEL);
+
+	XFER_TIMING_TIMER->TASKS_CAPTURE[CC_WAKE] = 1;
+	UART->ENABLE = UARTE_ENABLE_ENABLE_Enabled;
+	UART->RXD.PTR = (int)rx_buffer;
+	UART->RXD.MAXCNT = SESSION_RX_MAX;
+	UART->TASKS_STARTRX = 1;
+}
+
+static void session_disable(void)
+{
+	/* Disable the RDY event in two steps to prevent 23 µA current leak. */
+	GPIOTE->CONFIG[RDY_GPIOTE_NR] = GPIOTE_CONFIG_MODE_Disabled |
+					(PIN_RDY << GPIOTE_CONFIG_PSEL_Pos);
+	GPIOTE->CONFIG[RDY_GPIOTE_NR] = 0;
+	GPIOTE->PUBLISH_IN[RDY_GPIOTE_NR] = 0;
+	UART->SUBSCRIBE_STOPRX = 0;
+	NRF_DPPIC->CHENCLR = (1 << RDY_DPPI_CHANNEL);
 
-	/* Disable. */
 	UART->ENABLE = 0;
 }
 
+/* RDY went high, the peer asks for a session or acknowledges ours. */
+static void session_pin_isr(const void *arg)
+{
+	GPIOTE->EVENTS_PORT = 0;
+
+	/* Sense again once RDY is low at the end of the session. */
+	GPIO->PIN_CNF[PIN_RDY] = RDY_CNF;
+
+	if (session_state == SESSION_IDLE) {
+		/* Receive before acknowledging, the peer may send right away. */
+		session_enable();
+		GPIO->OUTSET = 1 << PIN_REQ;
+	}
+	session_state = SESSION_OPEN;
+
+	/* The peer receives since it raised REQ. */
+	XFER_TIMING_TIMER->TASKS_CAPTURE[CC_FIRST_BYTE] = 1;
+	if (session_frames) {
+		UART->TXD.MAXCNT = session_size;
+		UART->TASKS_STARTTX = 1;
+	}
+
+	k_sem_give(&session_opened);
+}
+
+/* Sleep until one of the sides wakes the link. */
+static void session_idle(void)
+{
+	k_sem_reset(&session_opened);
+	k_sem_reset(&session_tx);
+	k_sem_reset(&session_rx);
+	session_state = SESSION_IDLE;
+	GPIO->PIN_CNF[PIN_RDY] = RDY_SENSE_CNF;
+}
+
+static void session_pins_init(void)
+{
+	/* Output low, push-pull, only this side drives REQ. */
+	GPIO->OUTCLR = 1 << PIN_REQ;
+	GPIO->PIN_CNF[PIN_REQ] = GPIO_PIN_CNF_DIR_Output << GPIO_PIN_CNF_DIR_Pos;
+	session_idle();
+
+	serial_irq_connect(uarte1.irq, session_uart_isr, NULL);
+
+	GPIOTE->EVENTS_PORT = 0;
+	GPIOTE->INTENSET = GPIOTE_INTENSET_PORT_Msk;
+	irq_connect_dynamic(GPIOTE1_IRQn, 0, session_pin_isr, NULL, 0);
+	irq_enable(GPIOTE1_IRQn);
+}
+
+static void session_pins_deinit(void)
+{
+	irq_disable(GPIOTE1_IRQn);
+	GPIOTE->INTENCLR = GPIOTE_INTENCLR_PORT_Msk;
+	GPIOTE->EVENTS_PORT = 0;
+
+	serial_irq_connect(uarte1.irq, uart_isr, &uarte1);
+	uart_lp_pins_init();
+}
+
+/* Frames are back to back in rx_buffer, each starts with its size. */
+static int session_count_frames(int amount)
+{
+	int frames = 0;
+
+	for (int i = 0; i + session_size <= amount; i += session_size) {
+		if ((rx_buffer[i] << 8) + rx_buffer[i + 1] == session_size) {
+			frames++;
+		}
+	}
+
+	return frames;
+}
+
+/* One wake-up of the link sending session_frames frames. Wakes the peer if 'initiate',
+ * otherwise waits up to 'timeout' for the peer to do it.
+ */
+static int session_run(bool initiate, k_timeout_t timeout, struct session_stats *stats)
+{
+	uint32_t cycles = xfer_timing_cycles();
+	int frames = session_frames;
+	unsigned int key;
+	int err = 0;
+
+	if (initiate) {
+		/* The peer may have woken this side in the meantime. */
+		key = irq_lock();
+		if (session_state == SESSION_IDLE) {
+			session_state = SESSION_REQUESTED;
+			session_enable();
+			GPIO->OUTSET = 1 << PIN_REQ;
+		}
+		irq_unlock(key);
+	}
+
+	if (k_sem_take(&session_opened, timeout)) {
+		key = irq_lock();
+		if (session_state == SESSION_IDLE) {
+			irq_unlock(key);
+			return -ETIMEDOUT;
+		}
+		/* Nobody answered, a late answer is ignored. */
+		GPIO->PIN_CNF[PIN_RDY] = RDY_CNF;
+		GPIO->OUTCLR = 1 << PIN_REQ;
+		UART->TASKS_STOPRX = 1;
+		irq_unlock(key);
+		frames = 0;
+		err = -ETIMEDOUT;
+	} else {
+		stats->wakeups++;
+		if (initiate && stats->latencies < SESSION_LATENCIES) {
+			stats->latency_us[stats->latencies++] =
+				XFER_TIMING_TIMER->CC[CC_FIRST_BYTE] -
+				XFER_TIMING_TIMER->CC[CC_WAKE];
+		}
+	}
+
+	/* The pin interrupt started the first frame. */
+	for (int i = 1; i <= frames; i++) {
+		if (k_sem_take(&session_tx, SESSION_TIMEOUT)) {
+			err = -ETIMEDOUT;
+			break;
+		}
+		stats->sent++;
+		if (i < frames) {
+			UART->TASKS_STARTTX = 1;
+		}
+	}
+	UART->TASKS_STOPTX = 1;
+
+	/* Done sending, the peer stops receiving. Wait until it is done as well. */
+	GPIO->OUTCLR = 1 << PIN_REQ;
+	if (k_sem_take(&session_rx, SESSION_TIMEOUT)) {
+		UART->TASKS_STOPRX = 1;
+		k_sem_take(&session_rx, K_MSEC(10));
+		err = -ETIMEDOUT;
+	}
+	stats->received += session_count_frames(UART->RXD.AMOUNT);
+
+	session_disable();
+	XFER_TIMING_TIMER->TASKS_CAPTURE[CC_FIRST_BYTE] = 1;
+	stats->uart_on_us += XFER_TIMING_TIMER->CC[CC_FIRST_BYTE] - XFER_TIMING_TIMER->CC[CC_WAKE];
+	stats->cpu_cycles += xfer_timing_cycles() - cycles;
+
+	session_idle();
+
+	return err;
+}
+
+static int sessions_run(int size, bool initiate, struct session_stats *stats)
+{
+	int err = 0;
+
+	session_size = size;
+	session_frames = CONFIG_UART_SESSION_FRAMES;
+	session_pins_init();
+
+	for (int i = 0; i < SESSION_WAKEUPS && !err; i++) {
+		if (initiate) {
+			k_msleep(SESSION_GAP_MS);
+		}
+		err = session_run(initiate, SESSION_TIMEOUT, stats);
+	}
+
+	session_pins_deinit();
+
+	return err;
+}
+
+/* One-shot mode, every frame wakes the link through uart_lp_send() or uart_lp_recv(). */
+static int oneshot_run(int size, bool tx, struct session_stats *stats)
+{
+	int frames = SESSION_WAKEUPS * CONFIG_UART_SESSION_FRAMES;
+	int err = 0;
+
+	/* RDY of the peer going low starts TX through channel 1. */
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_FIRST_BYTE] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk |
+							    REQ_DPPI_CHANNEL;
+
+	for (int i = 0; i < frames; i++) {
+		uint32_t cycles;
+		uint32_t wake;
+		int ret;
+
+		if (tx) {
+			k_msleep(SESSION_GAP_MS);
+			XFER_TIMING_TIMER->TASKS_CAPTURE[CC_WAKE] = 1;
+		}
+		cycles = xfer_timing_cycles();
+		ret = tx ? uart_lp_send(size) : uart_lp_recv(size);
+		stats->cpu_cycles += xfer_timing_cycles() - cycles;
+
+		/* The pin interrupt captured the wake-up of the receiving side. */
+		wake = XFER_TIMING_TIMER->CC[CC_WAKE];
+		if (tx && stats->latencies < SESSION_LATENCIES) {
+			stats->latency_us[stats->latencies++] =
+				XFER_TIMING_TIMER->CC[CC_FIRST_BYTE] - wake;
+		}
+		XFER_TIMING_TIMER->TASKS_CAPTURE[CC_WAKE] = 1;
+		stats->uart_on_us += XFER_TIMING_TIMER->CC[CC_WAKE] - wake;
+		stats->wakeups++;
+
+		if (ret != size) {
+			err = ret < 0 ? ret : -EIO;
+			break;
+		}
+		if (tx) {
+			stats->sent++;
+		} else {
+			stats->received++;
+		}
+	}
+
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_FIRST_BYTE] = 0;
+
+	return err;
+}
+
+static void session_print(const char *label, struct session_stats *stats, bool cpu_time)
+{
+	uint32_t frames = MAX(stats->sent + stats->received, 1);
+	struct stats latency;
+
+	lp_printf("%-24s %7u %5u %5u  ", label, stats->wakeups, stats->sent, stats->received);
+	if (stats->latencies) {
+		stats_calc(stats->latency_us, stats->latencies, &latency);
+		lp_printf("%16u %5u  ", latency.p50, latency.max);
+	} else {
+		lp_printf("%16s %5s  ", "n/a", "n/a");
+	}
+	lp_printf("%14u  ", stats->uart_on_us / frames);
+	if (cpu_time) {
+		lp_printf("%9u\n", xfer_timing_cycles_to_us(stats->cpu_cycles) / frames);
+	} else {
+		lp_printf("%9s\n", "n/a");
+	}
+}
+
+/* Both sides run the same phases. Every frame wakes the link in one-shot mode, with 'first'
+ * sending. The sessions are woken by 'first' and then by the peer, both sides send in every
+ * session.
+ */
+static int session_compare(int size, bool first)
+{
+	static struct session_stats stats[3];
+	const char *labels[] = {
+		"One-shot",
+		first ? "Session, this side wakes" : "Session, peer wakes",
+		first ? "Session, peer wakes" : "Session, this side wakes",
+	};
+	bool cpu_time = xfer_timing_cycles_init();
+	int err;
+
+	/* A session receives all frames of the peer in rx_buffer. */
+	size = CLAMP(size, 2, SESSION_RX_MAX / CONFIG_UART_SESSION_FRAMES);
+	tx_buffer[0] = size >> 8;
+	tx_buffer[1] = size & 0xff;
+	memset(stats, 0, sizeof(stats));
+
+	err = oneshot_run(size, first, &stats[0]);
+	if (!err) {
+		err = sessions_run(size, first, &stats[1]);
+	}
+	if (!err) {
+		err = sessions_run(size, !first, &stats[2]);
+	}
+
+	lp_printf("%d frames of %d bytes per wake-up and side, times in us\n",
+		  CONFIG_UART_SESSION_FRAMES, size);
+	lp_printf("Mode                     Wakeups  Sent  Recv  Wake to byte p50   max  "
+		  "UARTE on/frame  CPU/frame\n");
+	for (int i = 0; i < ARRAY_SIZE(stats); i++) {
+		session_print(labels[i], &stats[i], cpu_time);
+	}
+
+	return err;
+}
+
+void uart_session_init(uint32_t bitrate)
+{
+	uart_lp_init(bitrate);
+	lp_printf("    REQ to RDY of the peer in both directions\n");
+}
+
+int uart_session_send(int size)
+{
+	return session_compare(size, true);
+}
+
+int uart_session_recv(int size)
+{
+	return session_compare(size, false);
+}
+
+/* Start receiving into rx_buffer as a ring, RX is never stopped between chunks.
+ * TIMER2 counts every received byte through DPPI so the write position is known without
+ * waking the CPU for each byte.
+ */
+void uart_ring_start(void)
+{
+	ring_chunk = 0;
+	ring_read = 0;
+	ring_lost = 0;
+
+	/* Count received bytes using channel 3. */
+	COUNTER->MODE = TIMER_MODE_MODE_LowPowerCounter;
+	COUNTER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	COUNTER->TASKS_CLEAR = 1;
+	COUNTER->TASKS_START = 1;
+	UART->PUBLISH_RXDRDY = UARTE_PUBLISH_RXDRDY_EN_Msk | RING_DPPI_CHANNEL;
+	COUNTER->SUBSCRIBE_COUNT = TIMER_SUBSCRIBE_COUNT_EN_Msk | RING_DPPI_CHANNEL;
+	NRF_DPPIC->CHENSET = (1 << RING_DPPI_CHANNEL);
+
+	/* Restart RX in the next chunk as soon as one is full, wake up only when it has started. */
+	ring_active = true;
+	k_sem_reset(&ring_data);
+	UART->RXD.PTR = (int)rx_buffer;
+	UART->RXD.MAXCNT = RING_CHUNK_SIZE;
+	UART->SHORTS = UARTE_SHORTS_ENDRX_STARTRX_Msk;
+	UART->EVENTS_RXSTARTED = 0;
+	UART->EVENTS_ENDRX = 0;
+	UART->INTENCLR = UARTE_INTENCLR_ENDRX_Msk;
+	UART->INTENSET = UARTE_INTENSET_RXSTARTED_Msk;
+	UART->TASKS_STARTRX = 1;
+}
+
+static uint32_t uart_ring_count(void)
+{
+	COUNTER->TASKS_CAPTURE[0] = 1;
+	return COUNTER->CC[0];
+}
+
+/* Copy up to 'size' received bytes to 'data', waiting at most 'timeout' for them at the
+ * chunk boundaries if nothing is available. Returns the number of bytes copied, 0 on timeout
+ * or -ENOBUFS if unread data was overwritten, the read position then skips the lost bytes.
+ */
+int uart_ring_read(uint8_t *data, int size, k_timeout_t timeout)
+{
+	k_timepoint_t end = sys_timepoint_calc(timeout);
+	uint32_t available = uart_ring_count() - ring_read;
+	uint32_t offset;
+	int len;
+
+	/* The first chunk starting gives the semaphore before anything was received. */
+	while (!available) {
+		if (k_sem_take(&ring_data, sys_timepoint_timeout(end))) {
+			return 0;
+		}
+		available = uart_ring_count() - ring_read;
+	}
+
+	if (available > RING_SIZE) {
+		ring_lost += available - RING_SIZE;
+		ring_read += available - RING_SIZE;
+		return -ENOBUFS;
+	}
+
+	len = MIN(available, size);
+	offset = ring_read % RING_SIZE;
+
+	if (offset + len > RING_SIZE) {
+		memcpy(data, &rx_buffer[offset], RING_SIZE - offset);
+		memcpy(&data[RING_SIZE - offset], rx_buffer, len - (RING_SIZE - offset));
+	} else {
+		memcpy(data, &rx_buffer[offset], len);
+	}
+
+	ring_read += len;
+
+	return len;
+}
+
+void uart_ring_stop(void)
+{
+	UART->SHORTS = 0;
+	UART->INTENCLR = UARTE_INTENCLR_RXSTARTED_Msk;
+	UART->EVENTS_RXTO = 0;
+	UART->TASKS_STOPRX = 1;
+	while (!UART->EVENTS_RXTO) {
+		k_busy_wait(10);
+	}
+	UART->EVENTS_RXTO = 0;
+	UART->EVENTS_ENDRX = 0;
+	ring_active = false;
+
+	COUNTER->TASKS_STOP = 1;
+	UART->PUBLISH_RXDRDY = 0;
+	COUNTER->SUBSCRIBE_COUNT = 0;
+	NRF_DPPIC->CHENCLR = (1 << RING_DPPI_CHANNEL);
+
+	/* Restore the single transfer configuration. */
+	UART->RXD.PTR = (int)rx_buffer;
+	UART->INTENSET = UARTE_INTENSET_ENDRX_Msk;
+}
+
+/* Send 'size' byte transfers back-to-back for a couple of seconds. */
+int uart_stream_send(int size)
+{
+	int64_t end = k_uptime_get() + STREAM_SECONDS * 1000;
+	uint64_t bytes = 0;
+	uint32_t start = k_cycle_get_32();
+	uint64_t us;
+
+	while (k_uptime_get() < end) {
+		bytes += uart_send(size);
+	}
+
+	us = k_cyc_to_us_floor64(k_cycle_get_32() - start);
+	lp_printf("Sent %llu bytes in %llu us, %llu bytes/s\n", bytes, us, bytes * 1000000 / us);
+
+	return 0;
+}
+
+/* Receive continuously until the line has been idle for a second. */
+int uart_stream_recv(int size)
+{
+	static uint8_t data[RING_CHUNK_SIZE];
+	uint64_t bytes = 0;
+	uint32_t first = 0;
+	uint32_t last = 0;
+	int first_len = 0;
+	int len;
+
+	uart_ring_start();
+
+	/* Wait for the peer to start. */
+	len = uart_ring_read(data, sizeof(data), K_SECONDS(60));
+
+	while (len != 0) {
+		if (len > 0) {
+			if (!first_len) {
+				first = k_cycle_get_32();
+				first_len = len;
+			}
+			last = k_cycle_get_32();
+			bytes += len;
+		}
+		len = uart_ring_read(data, sizeof(data), K_SECONDS(1));
+	}
+
+	uart_ring_stop();
+
+	if (!bytes) {
+		return -ETIMEDOUT;
+	}
+
+	lp_printf("Received %llu bytes", bytes);
+	if (last != first) {
+		/* The first read only marks the start, its bytes arrived before it. */
+		lp_printf(", %llu bytes/s",
+			  (bytes - first_len) * 1000000 / k_cyc_to_us_floor64(last - first));
+	}
+	if (ring_lost) {
+		lp_printf(RED ", %u bytes lost\n" NORMAL, ring_lost);
+	} else {
+		lp_printf(GREEN ", no bytes lost\n" NORMAL);
+	}
+
+	return 0;
+}
+
+void uart_instance_deinit(struct uarte_instance *uarte)
+{
+	irq_disable(uarte->irq);
+	GPIO->PIN_CNF[uarte->pin_txd] = 0;
+	uarte->regs->INTENCLR = UARTE_INTENCLR_ENDRX_Msk | UARTE_INTENCLR_ENDTX_Msk;
+	uarte->regs->PUBLISH_TXSTARTED = 0;
+	uarte->regs->PUBLISH_RXSTARTED = 0;
+	uarte->regs->PUBLISH_ENDTX = 0;
+	uarte->regs->PUBLISH_ENDRX = 0;
+
+	/* Disable. */
+	uarte->regs->ENABLE = 0;
+}
+
+void uart_deinit(void)
+{
+	uart_instance_deinit(&uarte1);
+}
+
 void uart_timeout_deinit(void)
 {
 	uart_deinit();
@@ -270,4 +1009,7 @@ void uart_timeout_deinit(void)
 	TIMER->PUBLISH_COMPARE[0] = 0;
 	UART->SUBSCRIBE_STOPRX = 0;
 	NRF_DPPIC->CHENCLR = (1 << 2);
+
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_LAST_BYTE] = 0;
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_TIMEOUT] = 0;
 }
@@ -9,13 +9,184 @@
 #include <zephyr/pm/device.h>
 
 #define USED_DEV DT_NODELABEL(uart1)
+#define UART NRF_UARTE1_NS
 
 const struct device *p_dev;
 
 int received;
 
+/* Streaming receive: the driver gets buffers from a slab and hands every chunk to the
+ * consumer thread through a lock-free single producer, single consumer queue. The consumer
+ * owns a buffer until the release item for it comes out of the queue.
+ */
+#define STREAM_BUF_SIZE 1024
+#define STREAM_BUF_COUNT 6
+/* 10 character times at 1 Mbps. */
+#define STREAM_TIMEOUT_US 100
+/* Power of two. */
+#define STREAM_QUEUE_SIZE 32
+#define STREAM_IDLE_MS 1000
+
+/* TIMER1 channels of the idle timeout measurement. */
+#define CC_LAST_BYTE 4
+#define CC_EVENT 5
+
+K_MEM_SLAB_DEFINE_STATIC(stream_slab, STREAM_BUF_SIZE, STREAM_BUF_COUNT, 4);
+
+enum stream_item_type {
+	STREAM_DATA,
+	STREAM_RELEASE,
+	STREAM_END,
+};
+
+struct stream_item {
+	enum stream_item_type type;
+	uint8_t *buf;
+	uint16_t len;
+	uint32_t event_us;	/* When the driver reported the chunk. */
+	uint32_t last_byte_us;	/* When the last byte of the chunk was received. */
+};
+
+static struct stream_item stream_queue[STREAM_QUEUE_SIZE];
+static atomic_t stream_head;	/* Only written by the UART callback. */
+static atomic_t stream_tail;	/* Only written by the consumer. */
+
+static bool streaming;
+static bool stream_byte_capture;
+static uint32_t stream_dropped;
+static uint32_t stream_no_buffer;
+
+K_SEM_DEFINE(stream_items, 0, 1);
+K_SEM_DEFINE(stream_ended, 0, 1);
+
+/* What the consumer has seen, read by the test thread. */
+static struct {
+	uint64_t bytes;
+	uint32_t chunks;
+	uint32_t first_us;
+	uint32_t first_len;
+	uint32_t last_us;
+	uint32_t timeout_us;
+} stream_stats;
+
+static bool stream_put(const struct stream_item *item)
+{
+	atomic_val_t head = atomic_get(&stream_head);
+
+	if (head - atomic_get(&stream_tail) == STREAM_QUEUE_SIZE) {
+		return false;
+	}
+	stream_queue[head % STREAM_QUEUE_SIZE] = *item;
+	/* Publishes the item, atomic_set() is a full barrier. */
+	atomic_set(&stream_head, head + 1);
+	k_sem_give(&stream_items);
+
+	return true;
+}
+
+static bool stream_get(struct stream_item *item)
+{
+	atomic_val_t tail = atomic_get(&stream_tail);
+
+	if (tail == atomic_get(&stream_head)) {
+		return false;
+	}
+	*item = stream_queue[tail % STREAM_QUEUE_SIZE];
+	atomic_set(&stream_tail, tail + 1);
+
+	return true;
+}
+
+static void stream_callback(struct uart_event *evt)
+{
+	struct stream_item item = {0};
+	uint8_t *buf;
+
+	switch (evt->type) {
+	case UART_RX_RDY:
+		XFER_TIMING_TIMER->TASKS_CAPTURE[CC_EVENT] = 1;
+		item.type = STREAM_DATA;
+		item.buf = evt->data.rx.buf + evt->data.rx.offset;
+		item.len = evt->data.rx.len;
+		item.event_us = XFER_TIMING_TIMER->CC[CC_EVENT];
+		item.last_byte_us = stream_byte_capture ? XFER_TIMING_TIMER->CC[CC_LAST_BYTE] :
+				    item.event_us;
+		if (!stream_put(&item)) {
+			stream_dropped++;
+		}
+		break;
+
+	case UART_RX_BUF_REQUEST:
+		if (k_mem_slab_alloc(&stream_slab, (void **)&buf, K_NO_WAIT) == 0) {
+			uart_rx_buf_rsp(p_dev, buf, STREAM_BUF_SIZE);
+		} else {
+			/* Reception stops at the end of the current buffer. */
+			stream_no_buffer++;
+		}
+		break;
+
+	case UART_RX_BUF_RELEASED:
+		item.type = STREAM_RELEASE;
+		item.buf = evt->data.rx_buf.buf;
+		/* Without a queue slot the data of the buffer is lost anyway. */
+		if (!stream_put(&item)) {
+			stream_dropped++;
+			k_mem_slab_free(&stream_slab, item.buf);
+		}
+		break;
+
+	case UART_RX_DISABLED:
+		item.type = STREAM_END;
+		if (!stream_put(&item)) {
+			stream_dropped++;
+			k_sem_give(&stream_ended);
+		}
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void stream_consumer(void *p1, void *p2, void *p3)
+{
+	struct stream_item item;
+
+	while (1) {
+		k_sem_take(&stream_items, K_FOREVER);
+
+		while (stream_get(&item)) {
+			switch (item.type) {
+			case STREAM_DATA:
+				if (!stream_stats.chunks) {
+					stream_stats.first_us = item.last_byte_us;
+					stream_stats.first_len = item.len;
+				}
+				stream_stats.chunks++;
+				stream_stats.bytes += item.len;
+				stream_stats.last_us = item.last_byte_us;
+				stream_stats.timeout_us = item.event_us - item.last_byte_us;
+				break;
+			case STREAM_RELEASE:
+				k_mem_slab_free(&stream_slab, item.buf);
+				break;
+			case STREAM_END:
+				k_sem_give(&stream_ended);
+				break;
+			}
+		}
+	}
+}
+
+K_THREAD_DEFINE(stream_consumer_id, 1024, stream_consumer, NULL, NULL, NULL, 5, 0, 0);
+
 void uart_callback(const struct device *dev, struct uart_event *evt, void *user_data)
 {
+	if (streaming) {
+		stream_callback(evt);
+		return;
+	}
+
 	if (evt->type == UART_RX_RDY) {
 		received = evt->data.rx.len;
 	} else if (evt->type == UART_RX_STOPPED) {
@@ -41,6 +212,12 @@ void init(void)
 	}
 
 	lp_printf("\nUsing %s %p %p %p\n", p_dev->name, p_dev->api, p_dev->config, p_dev->data);
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	UART->PUBLISH_TXSTARTED = UARTE_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	UART->PUBLISH_RXSTARTED = UARTE_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	UART->PUBLISH_ENDTX = UARTE_PUBLISH_ENDTX_EN_Msk | XFER_TIMING_DPPI_END;
+	UART->PUBLISH_ENDRX = UARTE_PUBLISH_ENDRX_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 
@@ -67,5 +244,91 @@ int recv(int size)
 
 void deinit(void)
 {
+	UART->PUBLISH_TXSTARTED = 0;
+	UART->PUBLISH_RXSTARTED = 0;
+	UART->PUBLISH_ENDTX = 0;
+	UART->PUBLISH_ENDRX = 0;
+}
+
+/* Receive until the line has been idle for STREAM_IDLE_MS. The last chunk is handed over by
+ * the inactivity timeout; TIMER1 captures every received byte on the DPPI channel the driver
+ * publishes RXDRDY on (hardware byte counting), so the delay from the last byte to that
+ * RX_RDY is the timeout latency.
+ */
+int stream_recv(int size)
+{
+	uint32_t rxdrdy;
+	uint64_t bytes = 0;
+	uint8_t *buf;
+	int idle_ms = 0;
+	int err;
+
+	memset(&stream_stats, 0, sizeof(stream_stats));
+	stream_dropped = 0;
+	stream_no_buffer = 0;
+	k_sem_reset(&stream_ended);
+
+	if (k_mem_slab_alloc(&stream_slab, (void **)&buf, K_NO_WAIT)) {
+		return -ENOMEM;
+	}
+
+	streaming = true;
+	err = uart_rx_enable(p_dev, buf, STREAM_BUF_SIZE, STREAM_TIMEOUT_US);
+	if (err) {
+		streaming = false;
+		k_mem_slab_free(&stream_slab, buf);
+		return err;
+	}
+
+	/* The driver connects RXDRDY only once reception is enabled. */
+	rxdrdy = UART->PUBLISH_RXDRDY;
+	stream_byte_capture = rxdrdy & UARTE_PUBLISH_RXDRDY_EN_Msk;
+	if (stream_byte_capture) {
+		XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_LAST_BYTE] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk |
+			(rxdrdy & UARTE_PUBLISH_RXDRDY_CHIDX_Msk);
+	}
+
+	/* Wait up to a minute for the sender, then until it stops. */
+	for (int ms = 0; ms < 60000 && idle_ms < STREAM_IDLE_MS; ms += 100) {
+		k_msleep(100);
+		if (stream_stats.bytes != bytes) {
+			bytes = stream_stats.bytes;
+			idle_ms = 0;
+		} else if (bytes) {
+			idle_ms += 100;
+		}
+	}
 
+	uart_rx_disable(p_dev);
+	k_sem_take(&stream_ended, K_SECONDS(1));
+	streaming = false;
+	XFER_TIMING_TIMER->SUBSCRIBE_CAPTURE[CC_LAST_BYTE] = 0;
+
+	lp_printf("Received %llu bytes in %u chunks", stream_stats.bytes, stream_stats.chunks);
+	if (stream_dropped) {
+		lp_printf(", %u queue overflows", stream_dropped);
+	}
+	if (stream_no_buffer) {
+		lp_printf(", ran out of buffers %u times", stream_no_buffer);
+	}
+	lp_printf("\n");
+
+	if (stream_stats.chunks > 1 && stream_stats.last_us != stream_stats.first_us) {
+		lp_printf("    Sustained %llu bytes/s\n",
+			  (stream_stats.bytes - stream_stats.first_len) * 1000000 /
+			  (stream_stats.last_us - stream_stats.first_us));
+	}
+	if (stream_byte_capture) {
+		lp_printf("    Last byte to RX_RDY %u us (timeout %u us)\n", stream_stats.timeout_us,
+			  STREAM_TIMEOUT_US);
+	} else {
+		lp_printf("    Timeout latency n/a, RXDRDY isn't published without "
+			  "CONFIG_UART_1_NRF_HW_ASYNC\n");
+	}
+
+	return stream_stats.bytes ? 0 : -ETIMEDOUT;
 }
+
+/* Added to the test menu of this backend. */
+#define BACKEND_TESTS \
+	{"Streaming receive until idle", 0, stream_recv},
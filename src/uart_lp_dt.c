@@ -9,22 +9,101 @@
 #include <zephyr/pm/device.h>
 
 #define USED_DEV DT_NODELABEL(lpuart)
+#define UART NRF_UARTE1_NS
 
 const struct device *p_dev;
 
-#define BUF_SIZE 4
-K_MEM_SLAB_DEFINE_STATIC(uart_slab, BUF_SIZE, 3, 4);
+/* Received data goes through a chain of slab buffers and is copied to rx_buffer. Every
+ * buffer costs a buffer request and an end interrupt, so the chunk size sets how often the
+ * CPU wakes up per byte. In adaptive mode a chunk that filled up in less than
+ * ADAPT_FILL_US doubles the next one, a chunk cut short by the receive timeout (idle line)
+ * halves it.
+ */
+#define CHUNK_MIN 4
+#define ADAPT_START 16
+#define ADAPT_FILL_US 500
+#define RX_TIMEOUT_US 1000
+/* Callbacks closer together than this come from the same interrupt. The system clock ticks
+ * every 30.5 µs, so callbacks in the same tick count as one wakeup.
+ */
+#define WAKEUP_GAP_US 10
+/* Released buffers come back before RX_DISABLED. */
+#define RX_DISABLE_TIMEOUT K_MSEC(100)
+
+K_MEM_SLAB_DEFINE_STATIC(uart_slab, CONFIG_UART_LP_RX_BUF_SIZE, CONFIG_UART_LP_RX_BUF_COUNT, 4);
 
 K_SEM_DEFINE(uart_rx_done, 0, 1);
 K_SEM_DEFINE(uart_tx_done, 0, 1);
+K_SEM_DEFINE(uart_rx_disabled, 0, 1);
+
+static struct {
+	int size;		/* Bytes wanted in rx_buffer. */
+	int received;
+	int overrun;		/* Bytes past 'size'. */
+	bool adaptive;
+	int chunk;		/* Size of the next buffer. */
+	uint32_t last_rdy;	/* Cycle time of the previous chunk. */
+	struct {
+		uint8_t *buf;
+		int size;
+	} bufs[CONFIG_UART_LP_RX_BUF_COUNT];
+	uint32_t no_buffer;
+	uint32_t callbacks;
+	uint32_t wakeups;
+	uint32_t last_callback;
+} rx;
+
+/* Remember the size of a buffer given to the driver, 0 when it comes back. */
+static void rx_buf_size_set(uint8_t *buf, int size)
+{
+	for (int i = 0; i < ARRAY_SIZE(rx.bufs); i++) {
+		if (rx.bufs[i].buf == buf || (size && !rx.bufs[i].buf)) {
+			rx.bufs[i].buf = size ? buf : NULL;
+			rx.bufs[i].size = size;
+			return;
+		}
+	}
+}
+
+static int rx_buf_size_get(const uint8_t *buf)
+{
+	for (int i = 0; i < ARRAY_SIZE(rx.bufs); i++) {
+		if (rx.bufs[i].buf == buf) {
+			return rx.bufs[i].size;
+		}
+	}
 
-int rx_bytes = 0;
+	return 0;
+}
+
+/* 'full' when the chunk ended its buffer, otherwise the receive timeout cut it short. */
+static void rx_adapt(uint32_t now, bool full)
+{
+	uint32_t fill_us = k_cyc_to_us_floor32(now - rx.last_rdy);
+
+	rx.last_rdy = now;
+	if (!rx.adaptive) {
+		return;
+	}
+	if (full && fill_us < ADAPT_FILL_US) {
+		rx.chunk = MIN(rx.chunk * 2, CONFIG_UART_LP_RX_BUF_SIZE);
+	} else if (!full) {
+		rx.chunk = MAX(rx.chunk / 2, CHUNK_MIN);
+	}
+}
 
 static void uart_callback(const struct device *dev,
 			  struct uart_event *evt,
 			  void *user_data)
 {
+	uint32_t now = k_cycle_get_32();
 	uint8_t *buf;
+	int len;
+
+	rx.callbacks++;
+	if (k_cyc_to_us_floor32(now - rx.last_callback) > WAKEUP_GAP_US) {
+		rx.wakeups++;
+	}
 
 	switch (evt->type) {
 	case UART_TX_DONE:
@@ -35,31 +114,42 @@ static void uart_callback(const struct device *dev,
 		break;
 
 	case UART_RX_RDY:
-		k_sem_give(&uart_rx_done);
-		if (evt->data.rx_buf.buf != rx_buffer) {
-			lp_printf("buffer overrun\n");
-			break;
+		len = MIN(evt->data.rx.len, rx.size - rx.received);
+		memcpy(&rx_buffer[rx.received], evt->data.rx.buf + evt->data.rx.offset, len);
+		rx.received += len;
+		rx.overrun += evt->data.rx.len - len;
+		rx_adapt(now, evt->data.rx.offset + evt->data.rx.len ==
+			 rx_buf_size_get(evt->data.rx.buf));
+		if (rx.received == rx.size) {
+			k_sem_give(&uart_rx_done);
 		}
-		rx_bytes = evt->data.rx.len;
 		break;
 
 	case UART_RX_BUF_REQUEST:
-		k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT);
-		uart_rx_buf_rsp(p_dev, buf, BUF_SIZE);
+		if (k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT)) {
+			rx.no_buffer++;
+			break;
+		}
+		rx_buf_size_set(buf, rx.chunk);
+		uart_rx_buf_rsp(p_dev, buf, rx.chunk);
 		break;
 
 	case UART_RX_BUF_RELEASED:
-		if (evt->data.rx_buf.buf != rx_buffer) {
-			k_mem_slab_free(&uart_slab, (void *)evt->data.rx_buf.buf);
-		}
+		rx_buf_size_set(evt->data.rx_buf.buf, 0);
+		k_mem_slab_free(&uart_slab, (void *)evt->data.rx_buf.buf);
 		break;
 
 	case UART_RX_DISABLED:
+		/* Out of buffers or stopped, nothing more will come. */
+		k_sem_give(&uart_rx_done);
+		k_sem_give(&uart_rx_disabled);
 		break;
 
 	case UART_RX_STOPPED:
 		break;
 	}
+
+	rx.last_callback = k_cycle_get_32();
 }
 
 void init(void)
@@ -89,6 +179,12 @@ void init(void)
 	if (err) {
 		lp_printf("Error setting call back: %d\n", err);
 	}
+
+	/* Publish start and end of a transfer for the timing measurement. */
+	UART->PUBLISH_TXSTARTED = UARTE_PUBLISH_TXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	UART->PUBLISH_RXSTARTED = UARTE_PUBLISH_RXSTARTED_EN_Msk | XFER_TIMING_DPPI_STARTED;
+	UART->PUBLISH_ENDTX = UARTE_PUBLISH_ENDTX_EN_Msk | XFER_TIMING_DPPI_END;
+	UART->PUBLISH_ENDRX = UARTE_PUBLISH_ENDRX_EN_Msk | XFER_TIMING_DPPI_END;
 }
 
 
@@ -106,26 +202,146 @@ int send(size_t size)
 	return size;
 }
 
-int recv(int size)
+/* Receive 'size' bytes into rx_buffer through buffers of 'chunk' bytes, or adaptive ones
+ * when 'chunk' is 0.
+ */
+static int lp_recv(int size, int chunk, k_timeout_t timeout)
 {
+	uint8_t *buf;
 	int err;
 
-	rx_bytes = 0;
+	memset(&rx, 0, sizeof(rx));
+	rx.size = size;
+	rx.adaptive = !chunk;
+	rx.chunk = chunk ? chunk : ADAPT_START;
+	rx.last_callback = k_cycle_get_32();
+	rx.last_rdy = rx.last_callback;
+	k_sem_reset(&uart_rx_done);
+	k_sem_reset(&uart_rx_disabled);
+
+	if (k_mem_slab_alloc(&uart_slab, (void **)&buf, K_NO_WAIT)) {
+		return -ENOMEM;
+	}
+	rx_buf_size_set(buf, rx.chunk);
 
-	err = uart_rx_enable(p_dev, rx_buffer, size, SYS_FOREVER_US);
+	err = uart_rx_enable(p_dev, buf, rx.chunk, RX_TIMEOUT_US);
 	if (err) {
 		lp_printf("Error enable rx: %d\n", err);
+		k_mem_slab_free(&uart_slab, buf);
 		return err;
 	}
 
-	k_sem_take(&uart_rx_done, K_FOREVER);
+	k_sem_take(&uart_rx_done, timeout);
 
+	/* Already disabled when it ran out of buffers. */
 	uart_rx_disable(p_dev);
+	if (k_sem_take(&uart_rx_disabled, RX_DISABLE_TIMEOUT)) {
+		lp_printf("RX not disabled\n");
+	}
 
-	return rx_bytes;
+	return rx.received;
 }
 
-void deinit(void)
+int recv(int size)
 {
+	int ret = lp_recv(size, IS_ENABLED(CONFIG_UART_LP_RX_ADAPTIVE) ? 0 :
+			  CONFIG_UART_LP_RX_BUF_SIZE, K_FOREVER);
 
+	if (ret < 0) {
+		return ret;
+	}
+
+	lp_printf("%u callbacks, %u wakeups", rx.callbacks, rx.wakeups);
+	if (rx.overrun) {
+		lp_printf(", %d bytes past the receive buffer dropped", rx.overrun);
+	}
+	if (rx.no_buffer) {
+		lp_printf(", out of RX buffers %u times", rx.no_buffer);
+	}
+	lp_printf("\n");
+
+	return ret;
+}
+
+#define SWEEP_PAUSE_MS 500
+
+static const int sweep_chunks[] = {4, 16, 64, 256, 1024, 0};
+
+/* Receive one transfer of 'size' bytes with every buffer size up to
+ * CONFIG_UART_LP_RX_BUF_SIZE and with adaptive buffers. Run sweep_send() with the same size
+ * on the peer.
+ */
+int rx_buffer_sweep(int size)
+{
+	bool cpu_time = xfer_timing_cycles_init();
+
+	lp_printf("Buffer   Bytes  Callbacks/KiB  Wakeups/KiB  CPU us/KiB\n");
+
+	for (int i = 0; i < ARRAY_SIZE(sweep_chunks); i++) {
+		int chunk = sweep_chunks[i];
+		uint32_t cpu_start;
+		uint32_t cpu_us;
+		int ret;
+
+		if (chunk > CONFIG_UART_LP_RX_BUF_SIZE) {
+			continue;
+		}
+
+		cpu_start = xfer_timing_cycles();
+		ret = lp_recv(size, chunk, K_SECONDS(10));
+		cpu_us = xfer_timing_cycles_to_us(xfer_timing_cycles() - cpu_start);
+
+		if (chunk) {
+			lp_printf("%6d", chunk);
+		} else {
+			lp_printf("  auto");
+		}
+		if (ret <= 0) {
+			lp_printf("  " RED "nothing received" NORMAL "\n");
+			continue;
+		}
+		lp_printf("  %6d  %13u  %11u  ", ret, rx.callbacks * 1024 / ret,
+			  rx.wakeups * 1024 / ret);
+		if (cpu_time) {
+			lp_printf("%10u\n", (uint32_t)((uint64_t)cpu_us * 1024 / ret));
+		} else {
+			lp_printf("       n/a\n");
+		}
+	}
+
+	return 0;
+}
+
+/* The transfers for rx_buffer_sweep() on the peer. */
+int sweep_send(int size)
+{
+	for (int i = 0; i < ARRAY_SIZE(sweep_chunks); i++) {
+		int ret;
+
+		/* Skipped by the receiver. */
+		if (sweep_chunks[i] > CONFIG_UART_LP_RX_BUF_SIZE) {
+			continue;
+		}
+
+		k_msleep(SWEEP_PAUSE_MS);
+		ret = send(size);
+		if (ret != size) {
+			return ret < 0 ? ret : -EIO;
+		}
+	}
+
+	return 0;
+}
+
+/* Added to the test menu of this backend. */
+#define BACKEND_TESTS \
+	{"Receive sweep of RX buffer sizes, 8 kbytes", 8 * 1024 - 2, rx_buffer_sweep}, \
+	{"Send for the RX buffer sweep, 8 kbytes", 8 * 1024 - 2, sweep_send},
+
+void deinit(void)
+{
+	UART->PUBLISH_TXSTARTED = 0;
+	UART->PUBLISH_RXSTARTED = 0;
+	UART->PUBLISH_ENDTX = 0;
+	UART->PUBLISH_ENDRX = 0;
 }
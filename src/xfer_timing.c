@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#include <zephyr/kernel.h>
+#include <zephyr/init.h>
+#if defined(CONFIG_NRFX_GPPI)
+#include <nrfx_gppi.h>
+#endif
+
+#include "term_color.h"
+#include "xfer_timing.h"
+
+#define TIMER XFER_TIMING_TIMER
+
+/* Channel group used to let the first start event disable its own channel. */
+#define STARTED_GROUP 5
+
+#define CC_BEGIN   0
+#define CC_STARTED 1
+#define CC_END     2
+#define CC_RETURN  3
+
+int lp_printf(const char *fmt, ...);
+
+BUILD_ASSERT(!IS_ENABLED(CONFIG_NRFX_TIMER1), "TIMER1 is used for the transfer timing");
+
+static bool reserved = !IS_ENABLED(CONFIG_NRFX_GPPI);
+
+#if defined(CONFIG_NRFX_GPPI)
+/* Drivers using the nrfx allocators (UART HW async RX counting) hand out DPPI channels and
+ * groups at init. Claim the fixed ones before they do, anything else allocated on the way is
+ * given back.
+ */
+static int xfer_timing_reserve(void)
+{
+	uint32_t channels = BIT(XFER_TIMING_DPPI_STARTED) | BIT(XFER_TIMING_DPPI_END);
+	uint32_t groups = BIT(STARTED_GROUP);
+	uint32_t other_channels = 0;
+	uint32_t other_groups = 0;
+	nrfx_gppi_channel_group_t group;
+	uint8_t channel;
+
+	while (channels && nrfx_gppi_channel_alloc(&channel) == NRFX_SUCCESS) {
+		if (channels & BIT(channel)) {
+			channels &= ~BIT(channel);
+		} else {
+			other_channels |= BIT(channel);
+		}
+	}
+	while (groups && nrfx_gppi_group_alloc(&group) == NRFX_SUCCESS) {
+		if (groups & BIT(group)) {
+			groups &= ~BIT(group);
+		} else {
+			other_groups |= BIT(group);
+		}
+	}
+
+	for (channel = 0; channel < 32; channel++) {
+		if (other_channels & BIT(channel)) {
+			nrfx_gppi_channel_free(channel);
+		}
+		if (other_groups & BIT(channel)) {
+			nrfx_gppi_group_free((nrfx_gppi_channel_group_t)channel);
+		}
+	}
+
+	reserved = !channels && !groups;
+	__ASSERT(reserved, "DPPI channels %u, %u or group %u already allocated",
+		 XFER_TIMING_DPPI_STARTED, XFER_TIMING_DPPI_END, STARTED_GROUP);
+
+	return reserved ? 0 : -EBUSY;
+}
+
+/* Before the UART driver init at CONFIG_SERIAL_INIT_PRIORITY. */
+SYS_INIT(xfer_timing_reserve, PRE_KERNEL_1, 0);
+#endif
+
+void xfer_timing_init(void)
+{
+	if (!reserved) {
+		lp_printf(RED "DPPI channels %u, %u or group %u are in use by a driver, transfer "
+			  "timing is not reliable\n" NORMAL,
+			  XFER_TIMING_DPPI_STARTED, XFER_TIMING_DPPI_END, STARTED_GROUP);
+	}
+
+	/* 1 MHz, 32 bit. The timer only runs during a measurement to save power. */
+	TIMER->MODE = TIMER_MODE_MODE_Timer;
+	TIMER->BITMODE = TIMER_BITMODE_BITMODE_32Bit;
+	TIMER->PRESCALER = 4;
+
+	/* Capture the start and end events published by the drivers. */
+	TIMER->SUBSCRIBE_CAPTURE[CC_STARTED] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk |
+					       XFER_TIMING_DPPI_STARTED;
+	TIMER->SUBSCRIBE_CAPTURE[CC_END] = TIMER_SUBSCRIBE_CAPTURE_EN_Msk | XFER_TIMING_DPPI_END;
+
+	/* A transfer can have several start events (streaming, write-then-read), disable the
+	 * start channel on the first one so that CC_STARTED keeps the first timestamp.
+	 */
+	NRF_DPPIC->CHG[STARTED_GROUP] = (1 << XFER_TIMING_DPPI_STARTED);
+	NRF_DPPIC->SUBSCRIBE_CHG[STARTED_GROUP].DIS = DPPIC_SUBSCRIBE_CHG_DIS_EN_Msk |
+						      XFER_TIMING_DPPI_STARTED;
+
+	NRF_DPPIC->CHENSET = (1 << XFER_TIMING_DPPI_END);
+}
+
+void xfer_timing_begin(void)
+{
+	/* Zero marks a missing event. */
+	TIMER->CC[CC_STARTED] = 0;
+	TIMER->CC[CC_END] = 0;
+	NRF_DPPIC->TASKS_CHG[STARTED_GROUP].EN = 1;
+
+	TIMER->TASKS_CLEAR = 1;
+	TIMER->TASKS_START = 1;
+	TIMER->TASKS_CAPTURE[CC_BEGIN] = 1;
+}
+
+void xfer_timing_end(struct xfer_timing *timing)
+{
+	uint32_t started;
+	uint32_t end;
+
+	TIMER->TASKS_CAPTURE[CC_RETURN] = 1;
+	TIMER->TASKS_STOP = 1;
+	NRF_DPPIC->TASKS_CHG[STARTED_GROUP].DIS = 1;
+
+	/* Without a start or end event the wire time runs from the call to the return. */
+	started = TIMER->CC[CC_STARTED];
+	if (!started) {
+		started = TIMER->CC[CC_BEGIN];
+	}
+	end = TIMER->CC[CC_END];
+	if (end < started) {
+		end = TIMER->CC[CC_RETURN];
+	}
+
+	timing->pre_us = started - TIMER->CC[CC_BEGIN];
+	timing->wire_us = end - started;
+	timing->post_us = TIMER->CC[CC_RETURN] - end;
+	timing->total_us = TIMER->CC[CC_RETURN] - TIMER->CC[CC_BEGIN];
+}
+
+bool xfer_timing_cycles_init(void)
+{
+	uint32_t start;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	start = DWT->CYCCNT;
+	k_busy_wait(10);
+
+	return DWT->CYCCNT != start;
+}
@@ -0,0 +1,65 @@
+/*
+ * Copyright (c) 2025 Nordic Semiconductor ASA
+ *
+ * SPDX-License-Identifier: LicenseRef-Nordic-5-Clause
+ *
+ */
+
+#ifndef XFER_TIMING_H_
+#define XFER_TIMING_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <zephyr/kernel.h>
+
+/* Drivers publish the start and end events of a transfer on these DPPI channels. Only the
+ * first start event and the last end event between xfer_timing_begin() and xfer_timing_end()
+ * are kept, so drivers can publish all their start and end events on them. The channels, the
+ * channel group used by xfer_timing.c and TIMER1 are fixed, they are claimed from the nrfx
+ * allocators at boot so that drivers allocating their own (UART HW async) don't get them.
+ */
+#define XFER_TIMING_DPPI_STARTED 14
+#define XFER_TIMING_DPPI_END     15
+
+/* A peripheral event can only be published on one channel, so drivers also use the END
+ * channel for their own tasks. It must stay enabled and carry the end event of every transfer,
+ * a change here breaks:
+ * - SPIM hardware chip select, CS released on END (spi_master_bare.c)
+ * - SPIM bursts, END starts the gap timer before the next frame (spi_master_bare.c)
+ * - SPIS streaming, END captures the gap before RELEASE (spi_slave_bare.c)
+ * - Pre-armed TWIS, STOPPED prepares the buffers again (twi_slave_bare.c)
+ */
+
+/* Timer running at 1 MHz during a measurement. CC[0] to CC[3] are used for the transfer
+ * timestamps, CC[4] and CC[5] are free for drivers capturing their own events.
+ */
+#define XFER_TIMING_TIMER        NRF_TIMER1_NS
+
+struct xfer_timing {
+	uint32_t pre_us;	/* From the call to the first start event. */
+	uint32_t wire_us;	/* From the first start event to the last end event. */
+	uint32_t post_us;	/* From the last end event to the return. */
+	uint32_t total_us;
+};
+
+void xfer_timing_init(void);
+void xfer_timing_begin(void);
+void xfer_timing_end(struct xfer_timing *timing);
+
+/* Enable the DWT cycle counter, returns false if it doesn't run (not writable from the
+ * non-secure side on every configuration). It only counts while the CPU clock runs, so the
+ * difference of two xfer_timing_cycles() readings is the time the CPU was awake.
+ */
+bool xfer_timing_cycles_init(void);
+
+static inline uint32_t xfer_timing_cycles(void)
+{
+	return DWT->CYCCNT;
+}
+
+static inline uint32_t xfer_timing_cycles_to_us(uint64_t cycles)
+{
+	return cycles * 1000000 / SystemCoreClock;
+}
+
+#endif /* XFER_TIMING_H_ */